@@ -0,0 +1,15 @@
+# Try to find the zstd library and headers
+#  ZSTD_FOUND - system has zstd
+#  ZSTD_INCLUDE_DIR - the zstd include directory
+#  ZSTD_LIBRARIES - Libraries needed to use zstd
+
+find_path(ZSTD_INCLUDE_DIR NAMES zstd.h  PATHS "$ENV{ZSTD_DIR}/include")
+find_library(ZSTD_LIBRARIES NAMES zstd   PATHS "$ENV{ZSTD_DIR}/lib")
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(ZSTD DEFAULT_MSG ZSTD_INCLUDE_DIR ZSTD_LIBRARIES)
+
+if(ZSTD_FOUND)
+  message(STATUS "Found zstd    (include: ${ZSTD_INCLUDE_DIR}, library: ${ZSTD_LIBRARIES})")
+  mark_as_advanced(ZSTD_INCLUDE_DIR ZSTD_LIBRARIES)
+endif()
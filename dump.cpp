@@ -0,0 +1,38 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <boost/program_options.hpp>
+#include "cbtl/ledger.h"
+#include "cbtl/blocks.h"
+#include "cbtl/snapshot.h"
+
+int main(int argc, char** argv) {
+    cbtl::config config;
+    std::string output;
+    boost::program_options::options_description desc("Writes all the blocks of the ledger into a snapshot file");
+    desc.add_options()
+        ("help,h",    "prints this help message")
+        ("output,o",  boost::program_options::value<std::string>(&output)->required(), "snapshot file to write")
+        ;
+    desc.add(config.storage_options());
+
+    boost::program_options::variables_map map;
+    boost::program_options::store(boost::program_options::parse_command_line(argc, argv, desc), map);
+    if(map.count("help")){
+        std::cout << desc << std::endl;
+        return 1;
+    }
+    boost::program_options::notify(map);
+
+    auto start = std::chrono::steady_clock::now();
+    cbtl::ledger db(config);
+    cbtl::snapshot::writer snapshot(output);
+    db.scan_blocks([&snapshot](const cbtl::blocks::access& block){
+        snapshot.write(block);
+    });
+    snapshot.close();
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    std::cout << snapshot.count() << " blocks written to " << output << " in " << elapsed << "ms" << std::endl;
+
+    return 0;
+}
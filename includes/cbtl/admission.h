@@ -0,0 +1,61 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef cbtl_ADMISSION_H
+#define cbtl_ADMISSION_H
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include "cbtl/config.h"
+
+namespace cbtl{
+
+/**
+ * @brief server wide counters of open sessions and queued crypto jobs, shared by all sessions
+ * A slot is taken with a try_ function and given back when the slot is destroyed.
+ */
+class admission{
+  public:
+    class slot{
+        std::atomic<std::size_t>* _counter;
+      public:
+        explicit slot(std::atomic<std::size_t>& counter): _counter(&counter) {}
+        slot(slot&& other) noexcept: _counter(other._counter) { other._counter = nullptr; }
+        slot(const slot&) = delete;
+        slot& operator=(const slot&) = delete;
+        slot& operator=(slot&& other) noexcept { std::swap(_counter, other._counter); return *this; }
+        ~slot() { if(_counter) _counter->fetch_sub(1, std::memory_order_relaxed); }
+    };
+  private:
+    std::atomic<std::size_t> _sessions;
+    std::atomic<std::size_t> _jobs;
+    std::size_t              _max_sessions;
+    std::size_t              _max_jobs;
+  public:
+    explicit admission(const cbtl::config& config): _sessions(0), _jobs(0), _max_sessions(config.max_sessions), _max_jobs(config.max_jobs) {}
+    /**
+     * @brief a slot for a new session, nullopt if max_sessions sessions are open
+     */
+    std::optional<slot> try_session() { return take(_sessions, _max_sessions); }
+    /**
+     * @brief a slot for a job on the compute pool, nullopt if max_jobs jobs are queued or running
+     */
+    std::optional<slot> try_job() { return take(_jobs, _max_jobs); }
+    std::size_t sessions() const { return _sessions.load(std::memory_order_relaxed); }
+    std::size_t jobs() const { return _jobs.load(std::memory_order_relaxed); }
+  private:
+    static std::optional<slot> take(std::atomic<std::size_t>& counter, std::size_t limit){
+        std::size_t current = counter.load(std::memory_order_relaxed);
+        do{
+            if(limit != 0 && current >= limit){
+                return std::nullopt;
+            }
+        }while(!counter.compare_exchange_weak(current, current + 1, std::memory_order_relaxed));
+        return slot(counter);
+    }
+};
+
+}
+
+#endif // cbtl_ADMISSION_H
@@ -0,0 +1,68 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef cbtl_STORAGE_ANY_H
+#define cbtl_STORAGE_ANY_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <optional>
+#include <functional>
+#include <boost/asio/io_context.hpp>
+#include "cbtl/config.h"
+#include "cbtl/compression.h"
+#include "cbtl/blocks_fwd.h"
+#include "cbtl/blocks/access.h"
+#include "cbtl/redis-async-storage.h"
+
+namespace cbtl{
+namespace engines{
+
+/**
+ * @brief storage engine chosen at start time by config.engine among the engines built into the library
+ * @throws std::invalid_argument on construction if the engine is unknown or was not built
+ */
+class any{
+    struct base{
+        virtual ~base() = default;
+        virtual bool add(const cbtl::blocks::access& block) = 0;
+        virtual std::vector<bool> add_batch(const std::vector<cbtl::blocks::access>& blocks) = 0;
+        virtual bool exists(const std::string& id, bool index) = 0;
+        virtual std::string id(const std::string& addr) = 0;
+        virtual cbtl::blocks::access fetch(const std::string& block_id) = 0;
+        virtual std::optional<cbtl::blocks::access> resolve(const std::string& address) = 0;
+        virtual void scan_addresses(const std::function<void (const std::string&)>& f) = 0;
+        virtual void scan_blocks(const std::function<void (const cbtl::blocks::access&)>& f) = 0;
+        virtual cbtl::compressor& compression() = 0;
+        virtual void attach(boost::asio::io_context& io) { }
+        virtual void detach() { }
+        virtual cbtl::async_storage* async(const std::string& id, bool index) { return 0x0; }
+    };
+    template <typename EngineT>
+    struct model;
+  public:
+    explicit any(const cbtl::config& config);
+    ~any();
+
+    bool add(const cbtl::blocks::access& block) { return _engine->add(block); }
+    std::vector<bool> add_batch(const std::vector<cbtl::blocks::access>& blocks) { return _engine->add_batch(blocks); }
+    bool exists(const std::string& id, bool index = false) { return _engine->exists(id, index); }
+    std::string id(const std::string& addr) { return _engine->id(addr); }
+    cbtl::blocks::access fetch(const std::string& block_id) { return _engine->fetch(block_id); }
+    std::optional<cbtl::blocks::access> resolve(const std::string& address) { return _engine->resolve(address); }
+    void scan_addresses(const std::function<void (const std::string&)>& f) { _engine->scan_addresses(f); }
+    void scan_blocks(const std::function<void (const cbtl::blocks::access&)>& f) { _engine->scan_blocks(f); }
+    cbtl::compressor& compression() { return _engine->compression(); }
+
+    void attach(boost::asio::io_context& io) { _engine->attach(io); }
+    void detach() { _engine->detach(); }
+    cbtl::async_storage* async(const std::string& id, bool index = false) { return _engine->async(id, index); }
+  private:
+    std::unique_ptr<base> _engine;
+};
+
+}
+}
+
+#endif // cbtl_STORAGE_ANY_H
@@ -5,35 +5,75 @@
 #define cbtl_STORAGE_BDB_H
 
 #include <string>
+#include <mutex>
+#include <vector>
+#include <optional>
+#include <functional>
 #include <db_cxx.h>
+#include "cbtl/config.h"
+#include "cbtl/compression.h"
 #include "cbtl/blocks_fwd.h"
 #include <cryptopp/integer.h>
 
 namespace cbtl{
+namespace engines{
 
-struct storage{
-    storage();
-    ~storage();
+/**
+ * @brief BerkeleyDB storage engine, the blocks and the address index are two databases of one environment in config.path
+ */
+struct bdb{
+    explicit bdb(const cbtl::config& config);
+    ~bdb();
 
     bool add(const cbtl::blocks::access& block);
+    std::vector<bool> add_batch(const std::vector<cbtl::blocks::access>& blocks);
     bool exists(const std::string& id, bool index = false);
 
     std::string id(const std::string& addr);
 
     cbtl::blocks::access fetch(const std::string& block_id);
 
+    /**
+     * @brief the block indexed by the address, nullopt if there is none
+     */
+    std::optional<cbtl::blocks::access> resolve(const std::string& address);
+
+    /**
+     * @brief calls f with every indexed address
+     */
+    void scan_addresses(const std::function<void (const std::string&)>& f);
+    /**
+     * @brief calls f with every stored block
+     */
+    void scan_blocks(const std::function<void (const cbtl::blocks::access&)>& f);
+    /**
+     * @brief compressor of the stored blocks
+     */
+    cbtl::compressor& compression() { return _compressor; }
+
     protected:
         void open();
         void close();
+        /**
+         * @brief opens the databases for the duration of the scope and closes them on every path out of it
+         */
+        struct scope{
+            bdb& _db;
+            explicit scope(bdb& db): _db(db) { _db.open(); }
+            ~scope() { _db.close(); }
+        };
 
     private:
+        cbtl::compressor _compressor;
         Db* _blocks;
         Db* _index;
         DbTxn* _transaction;
         DbEnv _env;
         bool _opened;
+        std::mutex _mutex;
 };
 
+}
 }
 
 #endif // cbtl_STORAGE_BDB_H
@@ -4,7 +4,9 @@
 #ifndef cbtl_BLOCKS_ACCESS_H
 #define cbtl_BLOCKS_ACCESS_H
 
+#include <optional>
 #include <cryptopp/integer.h>
+#include "cbtl/blocks_fwd.h"
 #include <cryptopp/osrng.h>
 #include <nlohmann/json.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
@@ -18,8 +20,6 @@
 
 namespace cbtl{
 
-struct storage;
-
 namespace blocks{
 
 struct params;
@@ -36,9 +36,14 @@ struct access{
 
     static access genesis(CryptoPP::AutoSeededRandomPool& rng, const cbtl::blocks::params& p, const cbtl::keys::identity::private_key& master, const CryptoPP::Integer& h);
     static access construct(CryptoPP::AutoSeededRandomPool& rng, const cbtl::blocks::params& p, const cbtl::keys::identity::private_key& master, const CryptoPP::Integer& active_request, const CryptoPP::Integer& gaccess, const CryptoPP::Integer& passive_forward_last, const cbtl::keys::view_key& view, const std::string message);
+    /**
+     * @brief constructs the block and sets active_next to $g^{\pi_{u} r_{u}}$, the token the active user would present to extend the active chain after this block
+     */
+    static access construct(CryptoPP::AutoSeededRandomPool& rng, const cbtl::blocks::params& p, const cbtl::keys::identity::private_key& master, const CryptoPP::Integer& active_request, const CryptoPP::Integer& gaccess, const CryptoPP::Integer& passive_forward_last, const cbtl::keys::view_key& view, const std::string message, CryptoPP::Integer& active_next);
 
     protected:
         friend class nlohmann::adl_serializer<cbtl::blocks::access>;
+        friend class cbtl::blocks::view;
         access(const parts::active& active, const parts::passive& passive, const addresses& addr, const contents& body, const boost::posix_time::ptime& requested);
     private:
         parts::active     _active;
@@ -49,11 +54,62 @@ struct access{
         boost::posix_time::ptime _created;
 };
 
-access genesis(cbtl::storage& db, const cbtl::keys::identity::public_key& pub);
+template <typename StorageT>
+access genesis(StorageT& db, const cbtl::keys::identity::public_key& pub){
+    return db.fetch(pub.genesis_id());
+}
+
+/**
+ * @brief walks a chain from the genesis block to its last block, StorageT is any cbtl::storage
+ */
 struct last{
-    static access active (cbtl::storage& db, const cbtl::keys::identity::public_key& pub, const cbtl::keys::identity::private_key& pri);
-    static access passive(cbtl::storage& db, const cbtl::keys::identity::public_key& pub, const cbtl::keys::identity::private_key& secret);
-    static access passive(cbtl::storage& db, const cbtl::keys::identity::public_key& pub, const CryptoPP::Integer& gaccess, const cbtl::keys::identity::private_key& master);
+    template <typename StorageT>
+    static access active (StorageT& db, const cbtl::keys::identity::public_key& pub, const cbtl::keys::identity::private_key& pri){
+        cbtl::blocks::access last = cbtl::blocks::genesis(db, pub);
+        while(true){
+            std::string address = last.active().next(pub.G(), last.address().id(), pri);
+            std::optional<access> next = db.resolve(address);
+            if(!next){
+                break;
+            }
+            last = std::move(*next);
+        }
+        return last;
+    }
+    template <typename StorageT>
+    static access passive(StorageT& db, const cbtl::keys::identity::public_key& pub, const cbtl::keys::identity::private_key& secret){
+        cbtl::blocks::access last = cbtl::blocks::genesis(db, pub);
+        while(true){
+            std::string address = last.passive().next(pub.G(), last.address().id(), secret);
+            std::optional<access> next = db.resolve(address);
+            if(!next){
+                break;
+            }
+            last = std::move(*next);
+        }
+        return last;
+    }
+    template <typename StorageT>
+    static access passive(StorageT& db, const cbtl::keys::identity::public_key& pub, const CryptoPP::Integer& gaccess, const cbtl::keys::identity::private_key& master){
+        return passive(db, pub, cbtl::blocks::genesis(db, pub), gaccess, master);
+    }
+    /**
+     * @brief walks the passive chain onwards from a block known to be on it
+     */
+    template <typename StorageT>
+    static access passive(StorageT& db, const cbtl::keys::identity::public_key& pub, const access& from, const CryptoPP::Integer& gaccess, const cbtl::keys::identity::private_key& master){
+        CryptoPP::Integer h = cbtl::utils::sha512::digest(gaccess, CryptoPP::Integer::UNSIGNED);
+        cbtl::blocks::access last = from;
+        while(true){
+            std::string address = last.passive().next(pub.G(), last.address().id(), h, master);
+            std::optional<access> next = db.resolve(address);
+            if(!next){
+                break;
+            }
+            last = std::move(*next);
+        }
+        return last;
+    }
 };
 
 }
@@ -5,6 +5,7 @@
 #define cbtl_BLOCKS_ACTIVE_H
 
 #include <cryptopp/integer.h>
+#include "cbtl/blocks_fwd.h"
 #include <cryptopp/osrng.h>
 #include <nlohmann/json.hpp>
 #include "cbtl/math/group.h"
@@ -47,6 +48,7 @@ struct active{
 
     protected:
         friend class nlohmann::adl_serializer<cbtl::blocks::parts::active>;
+        friend class cbtl::blocks::view;
         /**
          * @brief constructs the active part of a generic access block
          * Trapdoor t = $g^{\pi_{u}^{-1} r_{u}^{(0)}}$ is provided by the caller which is expected to be verified before calling the constructor.
@@ -5,6 +5,7 @@
 #define cbtl_BLOCKS_ADDRESSES_H
 
 #include <cryptopp/integer.h>
+#include "cbtl/blocks_fwd.h"
 #include <nlohmann/json.hpp>
 #include <string>
 
@@ -21,6 +22,7 @@ class addresses{
     CryptoPP::Integer _id;
 
     friend class nlohmann::adl_serializer<cbtl::blocks::addresses>;
+    friend class cbtl::blocks::view;
     addresses(const CryptoPP::Integer& active, const CryptoPP::Integer& passive);
     public:
         addresses(const addresses& other) = default;
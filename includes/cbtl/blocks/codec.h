@@ -0,0 +1,95 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef cbtl_BLOCKS_CODEC_H
+#define cbtl_BLOCKS_CODEC_H
+
+#include <array>
+#include <string>
+#include <cstdint>
+#include <string_view>
+#include <cryptopp/integer.h>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include "cbtl/blocks_fwd.h"
+
+namespace cbtl{
+
+class compressor;
+
+namespace blocks{
+
+/**
+ * @brief binary encoding of an access block, the format blocks are stored in
+ * Layout (all lengths and numbers big-endian):
+ *   magic "CB" | version u8 | flags u8 (compressor::flag if the rest is compressed, see compression.h)
+ *   12 integers in the order of view::field, each as u16 length followed by the magnitude (two's complement for the signed coordinates)
+ *   requested as i64 microseconds since epoch
+ *   message as u32 length followed by the ciphertext
+ * JSON (blocks/io.h) remains the export and debug format, deserialize() still reads blocks stored as JSON.
+ */
+namespace codec{
+    constexpr std::uint8_t version = 1;
+
+    std::string serialize(const cbtl::blocks::access& block);
+    cbtl::blocks::access deserialize(std::string_view data);
+    /**
+     * @brief same as above through the compressor of the storage engine
+     */
+    std::string serialize(const cbtl::blocks::access& block, cbtl::compressor& compressor);
+    cbtl::blocks::access deserialize(std::string_view data, cbtl::compressor& compressor);
+    /**
+     * @brief true if the data is in the binary encoding, false if it is (presumably) JSON
+     */
+    bool binary(std::string_view data);
+}
+
+/**
+ * @brief read only view over a binary encoded block, the fields are located once and point into the encoded bytes
+ * Integers are only decoded when asked for, so e.g. a chain walk can decode just the fields it needs.
+ * The view does not own the data, which must outlive it.
+ */
+class view{
+  public:
+    enum class field: std::uint8_t{
+        active_forward,
+        active_backward,
+        active_checksum,
+        passive_forward,
+        passive_backward,
+        passive_cipher,
+        address_active,
+        address_passive,
+        random_x,
+        random_y,
+        gamma,
+        super,
+        count
+    };
+  private:
+    std::string_view _data;
+    std::array<std::string_view, static_cast<std::size_t>(field::count)> _fields;
+    std::string_view _message;
+    std::int64_t     _requested;
+  public:
+    /**
+     * @brief throws std::invalid_argument if the data is truncated or of an unknown version
+     */
+    explicit view(std::string_view data);
+    std::uint8_t version() const { return static_cast<std::uint8_t>(_data[2]); }
+    /**
+     * @brief the encoded magnitude of the field
+     */
+    std::string_view raw(field f) const { return _fields[static_cast<std::size_t>(f)]; }
+    CryptoPP::Integer integer(field f) const;
+    std::string_view message() const { return _message; }
+    boost::posix_time::ptime requested() const;
+    /**
+     * @brief decodes all the fields into an access block
+     */
+    cbtl::blocks::access block() const;
+};
+
+}
+}
+
+#endif // cbtl_BLOCKS_CODEC_H
@@ -6,6 +6,7 @@
 
 #include "cbtl/math/diophantine.h"
 #include <cryptopp/integer.h>
+#include "cbtl/blocks_fwd.h"
 #include <string>
 #include "cbtl/keys.h"
 #include "cbtl/blocks/addresses.h"
@@ -21,6 +22,7 @@ struct contents{
     inline const CryptoPP::Integer& super() const { return _super; }
     private:
         friend class nlohmann::adl_serializer<cbtl::blocks::contents>;
+        friend class cbtl::blocks::view;
         contents(const cbtl::math::free_coordinates& random, const CryptoPP::Integer& gamma, const CryptoPP::Integer& super, const std::string& msg);
         void compute(const cbtl::math::free_coordinates& p1, const cbtl::math::free_coordinates& p2, const std::string& msg, const cbtl::math::group& G, const CryptoPP::Integer& super);
     private:
@@ -5,6 +5,7 @@
 #define cbtl_BLOCKS_PASSIVE_H
 
 #include <cryptopp/integer.h>
+#include "cbtl/blocks_fwd.h"
 #include <cryptopp/osrng.h>
 #include <nlohmann/json.hpp>
 #include "cbtl/math/group.h"
@@ -55,6 +56,7 @@ struct passive{
 
     protected:
         friend class nlohmann::adl_serializer<cbtl::blocks::parts::passive>;
+        friend class cbtl::blocks::view;
         passive(const CryptoPP::Integer& forward, const CryptoPP::Integer& backward, const CryptoPP::Integer& cipher);
     private:
         CryptoPP::Integer _forward;
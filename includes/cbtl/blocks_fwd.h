@@ -8,6 +8,7 @@ namespace cbtl{
 namespace blocks{
 
 struct access;
+class view;
 
 }
 }
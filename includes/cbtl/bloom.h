@@ -0,0 +1,37 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef cbtl_BLOOM_H
+#define cbtl_BLOOM_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <cstdint>
+
+namespace cbtl{
+
+/**
+ * @brief concurrent bloom filter of strings, insertions and queries are lock free
+ * A query that returns false is definite, true only means the key may have been inserted.
+ * Keys can not be removed, the false positive rate rises once more than expected keys are inserted.
+ */
+class bloom_filter{
+    std::size_t                                     _bits;
+    std::size_t                                     _hashes;
+    std::unique_ptr<std::atomic<std::uint64_t>[]>   _words;
+    std::atomic<std::size_t>                        _count;
+  public:
+    /**
+     * @brief sized for expected keys at the given false positive rate
+     */
+    explicit bloom_filter(std::size_t expected, double rate = 0.01);
+    void insert(const std::string& key);
+    bool possibly(const std::string& key) const;
+    std::size_t count() const { return _count.load(std::memory_order_relaxed); }
+    std::size_t bits() const { return _bits; }
+};
+
+}
+
+#endif // cbtl_BLOOM_H
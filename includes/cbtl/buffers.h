@@ -0,0 +1,59 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef cbtl_BUFFERS_H
+#define cbtl_BUFFERS_H
+
+#include <memory>
+#include <cstdint>
+#include <string_view>
+
+namespace cbtl{
+
+/**
+ * @brief contiguous byte buffer which is not zero filled on allocation and keeps its capacity when shrunk
+ */
+class buffer{
+    std::unique_ptr<char[]> _data;
+    std::size_t             _capacity;
+    std::size_t             _size;
+  public:
+    inline buffer(): _capacity(0), _size(0) {}
+    explicit buffer(std::size_t size);
+    buffer(buffer&& other) noexcept;
+    buffer& operator=(buffer&& other) noexcept;
+    buffer(const buffer&) = delete;
+    buffer& operator=(const buffer&) = delete;
+
+    /**
+     * @brief sets the size to n, the contents are not preserved if n exceeds the capacity
+     */
+    void resize(std::size_t n);
+    inline char* data() { return _data.get(); }
+    inline const char* data() const { return _data.get(); }
+    inline std::size_t size() const { return _size; }
+    inline std::size_t capacity() const { return _capacity; }
+    inline bool empty() const { return _size == 0; }
+    inline std::string_view view() const { return std::string_view(_data.get(), _size); }
+};
+
+/**
+ * @brief per thread free list of buffers so that frames of similar size reuse the same allocation
+ */
+struct buffer_pool{
+    static constexpr std::size_t max_buffers  = 16;                  ///< buffers retained per thread
+    static constexpr std::size_t max_retained = 8 * 1024 * 1024;     ///< larger buffers are freed instead of being retained
+
+    /**
+     * @brief returns a buffer of the requested size from the calling thread's free list (allocates if none is large enough)
+     */
+    static buffer acquire(std::size_t size);
+    /**
+     * @brief returns the buffer to the calling thread's free list
+     */
+    static void release(buffer&& buff);
+};
+
+}
+
+#endif // cbtl_BUFFERS_H
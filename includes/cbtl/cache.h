@@ -0,0 +1,62 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef cbtl_CACHE_H
+#define cbtl_CACHE_H
+
+#include <list>
+#include <mutex>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <optional>
+#include <unordered_map>
+#include "cbtl/blocks/access.h"
+
+namespace cbtl{
+
+/**
+ * @brief sharded LRU cache of decoded blocks keyed by block id
+ * Blocks are immutable once written, so an entry never has to be invalidated, only evicted.
+ * Each shard has its own lock, a key always maps to the same shard.
+ */
+class block_cache{
+  public:
+    static constexpr std::size_t shards = 16;
+    struct statistics{
+        std::size_t hits;
+        std::size_t misses;
+        std::size_t evictions;
+        std::size_t size;
+    };
+  private:
+    using value_type = std::shared_ptr<const cbtl::blocks::access>;
+    struct shard{
+        using list_type = std::list<std::pair<std::string, value_type>>;
+        std::mutex                                             mutex;
+        list_type                                              order;   ///< most recently used first
+        std::unordered_map<std::string, list_type::iterator>   index;
+    };
+    std::size_t                 _capacity;  ///< per shard
+    std::array<shard, shards>   _shards;
+    std::atomic<std::size_t>    _hits;
+    std::atomic<std::size_t>    _misses;
+    std::atomic<std::size_t>    _evictions;
+  public:
+    /**
+     * @brief capacity is the total number of blocks kept, 0 disables the cache
+     */
+    explicit block_cache(std::size_t capacity);
+    std::optional<cbtl::blocks::access> get(const std::string& id);
+    bool contains(const std::string& id);
+    void put(const std::string& id, const cbtl::blocks::access& block);
+    statistics stats();
+    bool enabled() const { return _capacity > 0; }
+  private:
+    shard& locate(const std::string& id);
+};
+
+}
+
+#endif // cbtl_CACHE_H
@@ -0,0 +1,141 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef cbtl_COMBINER_H
+#define cbtl_COMBINER_H
+
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <thread>
+#include <future>
+#include <cstdint>
+#include <exception>
+#include <condition_variable>
+#include <boost/noncopyable.hpp>
+#include "cbtl/blocks.h"
+
+namespace cbtl{
+
+/**
+ * @brief group commit of the blocks added by concurrent sessions
+ * The blocks are queued and written by one thread with storage::add_batch once batch blocks are queued or the oldest
+ * one has waited delay microseconds, whichever comes first. Blocks queued while a batch is being written form the next one.
+ * With batch <= 1 every block is written by the caller itself, as storage::add does.
+ * add() blocks the calling thread until its batch is written. A batch larger than the number of threads that may call
+ * add() concurrently never fills and always waits the full delay, so the batch has to be capped at that number.
+ */
+template <typename StorageT>
+class write_combiner: private boost::noncopyable{
+    struct pending{
+        cbtl::blocks::access block;
+        std::promise<bool>   written;
+    };
+    using clock_type = std::chrono::steady_clock;
+  public:
+    write_combiner(StorageT& db, std::size_t batch, std::uint32_t delay): _db(db), _batch(batch), _delay(delay), _stopped(false) {
+        if(_batch > 1){
+            _thread = std::thread([this]{ drain(); });
+        }
+    }
+    /**
+     * @brief writes the blocks still queued before returning
+     */
+    ~write_combiner(){
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopped = true;
+        }
+        _ready.notify_one();
+        if(_thread.joinable()){
+            _thread.join();
+        }
+    }
+    /**
+     * @brief queues the block, the future is ready once the batch holding it is written, false if the block or either address already exists
+     */
+    std::future<bool> submit(const cbtl::blocks::access& block){
+        std::promise<bool> written;
+        std::future<bool> future = written.get_future();
+        if(_batch <= 1){
+            try{
+                written.set_value(_db.add(block));
+            }catch(...){
+                written.set_exception(std::current_exception());
+            }
+            return future;
+        }
+        std::size_t size;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if(_queue.empty()){
+                _oldest = clock_type::now();
+            }
+            _queue.push_back(pending{block, std::move(written)});
+            size = _queue.size();
+        }
+        // the first block starts the clock, a full batch cuts it short
+        if(size == 1 || size >= _batch){
+            _ready.notify_one();
+        }
+        return future;
+    }
+    /**
+     * @brief blocks until the block is written, same result as storage::add
+     */
+    bool add(const cbtl::blocks::access& block){
+        return submit(block).get();
+    }
+
+  private:
+    void drain(){
+        std::unique_lock<std::mutex> lock(_mutex);
+        while(true){
+            _ready.wait(lock, [this]{ return _stopped || !_queue.empty(); });
+            if(_queue.empty()){
+                return;
+            }
+            _ready.wait_until(lock, _oldest + std::chrono::microseconds(_delay), [this]{ return _stopped || _queue.size() >= _batch; });
+            std::deque<pending> batch;
+            batch.swap(_queue);
+            lock.unlock();
+            flush(batch);
+            lock.lock();
+        }
+    }
+    void flush(std::deque<pending>& batch){
+        std::vector<cbtl::blocks::access> blocks;
+        blocks.reserve(batch.size());
+        for(const pending& p: batch){
+            blocks.push_back(p.block);
+        }
+        try{
+            std::vector<bool> written = _db.add_batch(blocks);
+            for(std::size_t i = 0; i < batch.size(); ++i){
+                batch[i].written.set_value(written[i]);
+            }
+        }catch(...){
+            // the storage failed the whole batch, every session waiting on it sees the error
+            std::exception_ptr ex = std::current_exception();
+            for(pending& p: batch){
+                p.written.set_exception(ex);
+            }
+        }
+    }
+
+  private:
+    StorageT&                _db;
+    std::size_t              _batch;
+    std::uint32_t            _delay;     ///< microseconds
+    std::deque<pending>      _queue;
+    clock_type::time_point   _oldest;    ///< when the first block of the queue was queued
+    bool                     _stopped;
+    std::mutex               _mutex;
+    std::condition_variable  _ready;
+    std::thread              _thread;
+};
+
+}
+
+#endif // cbtl_COMBINER_H
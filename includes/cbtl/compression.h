@@ -0,0 +1,75 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef cbtl_COMPRESSION_H
+#define cbtl_COMPRESSION_H
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+#include <string_view>
+#include <boost/noncopyable.hpp>
+#include "cbtl/config.h"
+
+namespace cbtl{
+
+/**
+ * @brief optional zstd compression of the stored (binary encoded) blocks
+ * A compressed value keeps the 4 byte codec header with the compressed flag set, followed by the u32 size of the
+ * encoded body and the zstd frame of the body. Compressed and uncompressed values coexist, unpack() passes the
+ * latter through, so the compression level can be changed on an existing ledger.
+ * The dictionary (zstd --train over exported blocks) is needed to read the values compressed with it.
+ * Safe to be shared by concurrent sessions.
+ */
+class compressor: private boost::noncopyable{
+  public:
+    static constexpr std::uint8_t flag = 0x01;   ///< bit of the reserved codec header byte
+    struct statistics{
+        std::uint64_t packed;       ///< values compressed, the others did not shrink and are stored as they are
+        std::uint64_t raw;          ///< bytes of all the values given to pack() before compression
+        std::uint64_t stored;       ///< bytes of all the values pack() returned
+        std::uint64_t pack_time;    ///< microseconds spent in pack()
+        std::uint64_t unpacked;     ///< values decompressed
+        std::uint64_t unpack_time;  ///< microseconds spent decompressing
+
+        double ratio() const { return stored ? double(raw) / double(stored) : 1.0; }
+    };
+    /**
+     * @brief compresses at config.compression (0 disables compression) with the dictionary at config.compression_dict if not empty
+     * @throws std::invalid_argument if compression is asked for but cbtl was built without zstd, std::runtime_error if the dictionary cannot be loaded
+     */
+    explicit compressor(const cbtl::config& config);
+    ~compressor();
+
+    bool enabled() const { return _level > 0; }
+    /**
+     * @brief compressed form of the encoded block, the encoded block itself if compression is disabled or does not pay off
+     */
+    std::string pack(std::string encoded);
+    /**
+     * @brief the encoded block of a stored value, either data itself or data decompressed into buffer
+     * @throws std::invalid_argument if the size a compressed value claims disagrees with its zstd frame or exceeds config.max_frame
+     */
+    std::string_view unpack(std::string_view data, std::string& buffer);
+    /**
+     * @brief true if data is a binary encoded block with the compressed flag set, false for JSON and uncompressed blocks
+     */
+    static bool compressed(std::string_view data);
+    statistics stats() const;
+
+  private:
+    int                         _level;
+    void*                       _cdict;
+    void*                       _ddict;
+    std::size_t                 _limit;   ///< largest encoded block unpack() decompresses
+    std::atomic<std::uint64_t>  _packed;
+    std::atomic<std::uint64_t>  _raw;
+    std::atomic<std::uint64_t>  _stored;
+    std::atomic<std::uint64_t>  _pack_time;
+    std::atomic<std::uint64_t>  _unpacked;
+    std::atomic<std::uint64_t>  _unpack_time;
+};
+
+}
+
+#endif // cbtl_COMPRESSION_H
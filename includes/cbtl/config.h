@@ -0,0 +1,52 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef cbtl_CONFIG_H
+#define cbtl_CONFIG_H
+
+#include <cstdint>
+#include <algorithm>
+#include <thread>
+#include <string>
+#include <vector>
+#include <boost/program_options/options_description.hpp>
+
+namespace cbtl{
+
+/**
+ * @brief runtime tunables of the Trusted Server
+ */
+struct config{
+    std::size_t workers = 1;                                                   ///< number of server processes sharing the port through SO_REUSEPORT
+    std::size_t threads = std::max(1u, std::thread::hardware_concurrency());   ///< number of threads running the io_context
+    std::size_t compute = std::max(1u, std::thread::hardware_concurrency());   ///< number of threads running the modular arithmetic of the sessions
+    std::string engine = "redis";                                              ///< storage engine (redis, bdb, lmdb or memory) when built with CBTL_STORAGE=any
+    std::string path = "storage";                                              ///< directory of the file backed storage engines
+    int         compression = 0;                                               ///< zstd level the stored blocks are compressed at, 0 stores them uncompressed
+    std::string compression_dict;                                              ///< zstd dictionary of the stored blocks, needed to read blocks compressed with it
+    std::vector<std::string> redis = {"127.0.0.1:6379"};                       ///< redis instances (host:port) the keys are sharded over by consistent hashing
+    std::size_t address_digest = 0;                                            ///< bytes of SHA-256 the redis address keys are truncated to, 0 keeps the whole address
+    std::size_t connections = threads + compute;                               ///< size of the redis connection pool of each instance
+    std::size_t cache_blocks = 4096;                                           ///< decoded blocks kept in memory per worker, 0 disables the cache
+    std::size_t tip_cache = 65536;                                             ///< passive chain tips kept per worker, 0 disables the cache
+    std::size_t write_batch = 64;                                              ///< blocks of concurrent sessions written together, 1 writes every block on its own
+    std::uint32_t write_delay = 200;                                           ///< microseconds a block waits for its batch to fill
+    std::size_t index_filter = 0;                                              ///< addresses the bloom filter over the address index is sized for, 0 disables it (only safe with a single writer)
+    std::uint32_t max_frame = 64 * 1024 * 1024;                                ///< largest frame body (in bytes) a session accepts
+    std::uint32_t ticket_lifetime = 300;                                       ///< seconds a resumption ticket stays valid, 0 disables resumption
+    std::size_t   max_sessions = 1024;                                         ///< open sessions beyond which new connections are turned away, 0 for no limit
+    std::size_t   max_jobs = 64 * compute;                                     ///< crypto jobs queued on the compute pool beyond which frames are turned away, 0 for no limit
+    std::size_t   max_inflight = 32;                                           ///< frames of one connection being handled at once
+    std::uint32_t retry_after = 1;                                             ///< seconds a turned away client is asked to wait
+    std::uint32_t handshake_timeout = 10;                                      ///< seconds a client has to send its first frame or to answer a challenge
+    std::uint32_t idle_timeout = 60;                                           ///< seconds an idle connection is kept open
+
+    /**
+     * @brief command line options of the storage (--engine, --storage, --redis, --address-digest, --compression, --compression-dict) bound to this config, shared by all the tools opening the ledger
+     */
+    boost::program_options::options_description storage_options();
+};
+
+}
+
+#endif // cbtl_CONFIG_H
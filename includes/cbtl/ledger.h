@@ -0,0 +1,45 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef cbtl_LEDGER_H
+#define cbtl_LEDGER_H
+
+#include "cbtl/storage.h"
+
+#if defined(CBTL_STORAGE_ANY)
+#include "cbtl/any-storage.h"
+#elif defined(CBTL_STORAGE_MEMORY)
+#include "cbtl/memory-storage.h"
+#elif defined(CBTL_STORAGE_LMDB)
+#include "cbtl/lmdb-storage.h"
+#elif defined(CBTL_STORAGE_BDB)
+#include "cbtl/bdb-storage.h"
+#else
+#include "cbtl/redis-storage.h"
+#endif
+
+namespace cbtl{
+
+/**
+ * @brief the storage engine the library is built with, selected by the CBTL_STORAGE cmake option
+ */
+#if defined(CBTL_STORAGE_ANY)
+using engine = engines::any;
+#elif defined(CBTL_STORAGE_MEMORY)
+using engine = engines::memory;
+#elif defined(CBTL_STORAGE_LMDB)
+using engine = engines::lmdb;
+#elif defined(CBTL_STORAGE_BDB)
+using engine = engines::bdb;
+#else
+using engine = engines::redis;
+#endif
+
+/**
+ * @brief the storage used by the server and the command line tools
+ */
+using ledger = storage<engine>;
+
+}
+
+#endif // cbtl_LEDGER_H
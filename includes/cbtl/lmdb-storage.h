@@ -0,0 +1,103 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef cbtl_STORAGE_LMDB_H
+#define cbtl_STORAGE_LMDB_H
+
+#include <string>
+#include <vector>
+#include <optional>
+#include <string_view>
+#include <stdexcept>
+#include <functional>
+#include <boost/noncopyable.hpp>
+#include <lmdb.h>
+#include "cbtl/config.h"
+#include "cbtl/compression.h"
+#include "cbtl/blocks_fwd.h"
+
+namespace cbtl{
+namespace engines{
+
+/**
+ * @brief LMDB storage engine, the blocks and the address index are two databases of one memory mapped environment
+ * Reads run in lock free read transactions and see the values in place in the map, writes are serialized by LMDB.
+ * The environment may be shared by several processes on the same host.
+ */
+class lmdb: private boost::noncopyable{
+    class transaction{
+        MDB_txn* _txn;
+      public:
+        transaction(MDB_env* env, bool readonly);
+        ~transaction();
+        MDB_txn* get() const { return _txn; }
+        void commit();
+    };
+  public:
+    static constexpr std::size_t map_size = std::size_t(1) << 36;
+
+    explicit lmdb(const cbtl::config& config);
+    ~lmdb();
+
+    /**
+     * @brief writes the block and its addresses in one transaction, false if the block or either address already exists
+     */
+    bool add(const cbtl::blocks::access& block);
+    /**
+     * @brief writes all the blocks in one transaction, returns for each block whether it was written
+     */
+    std::vector<bool> add_batch(const std::vector<cbtl::blocks::access>& blocks);
+    bool exists(const std::string& id, bool index = false);
+
+    std::string id(const std::string& addr);
+
+    cbtl::blocks::access fetch(const std::string& block_id);
+
+    /**
+     * @brief the block indexed by the address looked up in one read transaction, nullopt if there is none
+     */
+    std::optional<cbtl::blocks::access> resolve(const std::string& address);
+
+    /**
+     * @brief calls f with the serialized (possibly compressed) block as it lies in the map, the view is only valid during the call
+     * @throws std::out_of_range if there is no such block
+     */
+    template <typename F>
+    auto view(const std::string& block_id, F&& f){
+        transaction txn(_env, true);
+        std::string_view value;
+        if(!get(txn.get(), _blocks, block_id, value)){
+            throw std::out_of_range("block "+ block_id + " not found");
+        }
+        return f(value);
+    }
+
+    /**
+     * @brief calls f with every indexed address
+     */
+    void scan_addresses(const std::function<void (const std::string&)>& f);
+    /**
+     * @brief calls f with every stored block
+     */
+    void scan_blocks(const std::function<void (const cbtl::blocks::access&)>& f);
+    /**
+     * @brief compressor of the stored blocks
+     */
+    cbtl::compressor& compression() { return _compressor; }
+
+  private:
+    bool get(MDB_txn* txn, MDB_dbi dbi, std::string_view key, std::string_view& value);
+    bool insert(MDB_txn* txn, const cbtl::blocks::access& block);
+    static void check(int rc, const char* what);
+
+  private:
+    cbtl::compressor _compressor;
+    MDB_env* _env;
+    MDB_dbi  _blocks;
+    MDB_dbi  _index;
+};
+
+}
+}
+
+#endif // cbtl_STORAGE_LMDB_H
@@ -0,0 +1,74 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef cbtl_STORAGE_MEMORY_H
+#define cbtl_STORAGE_MEMORY_H
+
+#include <string>
+#include <vector>
+#include <optional>
+#include <functional>
+#include <shared_mutex>
+#include <unordered_map>
+#include <boost/noncopyable.hpp>
+#include "cbtl/config.h"
+#include "cbtl/compression.h"
+#include "cbtl/blocks_fwd.h"
+
+namespace cbtl{
+namespace engines{
+
+/**
+ * @brief in process hash table storage engine for benchmarks and tests
+ * The ledger lives only as long as the process. If config.path is set it is loaded from config.path/memory.ledger
+ * on construction and, if blocks were added, written back on destruction, so that e.g. cbtl-init can seed the ledger of
+ * a server. The file is replaced by a rename, a process that added nothing leaves it alone.
+ */
+class memory: private boost::noncopyable{
+  public:
+    explicit memory(const cbtl::config& config);
+    ~memory();
+
+    bool add(const cbtl::blocks::access& block);
+    std::vector<bool> add_batch(const std::vector<cbtl::blocks::access>& blocks);
+    bool exists(const std::string& id, bool index = false);
+
+    std::string id(const std::string& addr);
+
+    cbtl::blocks::access fetch(const std::string& block_id);
+    std::optional<cbtl::blocks::access> resolve(const std::string& address);
+
+    /**
+     * @brief calls f with every indexed address
+     */
+    void scan_addresses(const std::function<void (const std::string&)>& f);
+    /**
+     * @brief calls f with every stored block
+     */
+    void scan_blocks(const std::function<void (const cbtl::blocks::access&)>& f);
+    /**
+     * @brief compressor of the stored blocks
+     */
+    cbtl::compressor& compression() { return _compressor; }
+
+  private:
+    bool insert(const cbtl::blocks::access& block);
+    void load();
+    /**
+     * @brief writes the ledger to a temporary file and renames it over the ledger, throws std::runtime_error if the write fails
+     */
+    void save();
+
+  private:
+    cbtl::compressor                             _compressor;
+    std::string                                  _file;
+    bool                                         _dirty;   ///< blocks were added since the ledger was loaded
+    std::unordered_map<std::string, std::string> _blocks;  ///< block id -> serialized block
+    std::unordered_map<std::string, std::string> _index;   ///< address -> block id
+    std::shared_mutex                            _mutex;
+};
+
+}
+}
+
+#endif // cbtl_STORAGE_MEMORY_H
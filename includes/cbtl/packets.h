@@ -6,6 +6,9 @@
 
 #include <iostream>
 #include <cstdint>
+#include <array>
+#include <vector>
+#include <variant>
 #include <cryptopp/integer.h>
 #include <nlohmann/json.hpp>
 #include <arpa/inet.h>
@@ -15,6 +18,7 @@
 #include "cbtl/keys/private.h"
 #include "cbtl/keys/access.h"
 #include "cbtl/utils.h"
+#include "cbtl/blocks/access.h"
 
 namespace cbtl{
 
@@ -30,8 +34,6 @@ namespace identity{
 }
 }
 
-struct storage;
-
 namespace packets{
 
 enum class type{
@@ -39,7 +41,8 @@ enum class type{
     request,
     challenge,
     response,
-    result
+    result,
+    resume
 };
 
 enum class actions{
@@ -47,7 +50,8 @@ enum class actions{
     identify,
     fetch,
     insert,
-    remove
+    remove,
+    batch
 };
 
 template <actions A>
@@ -117,6 +121,26 @@ class action_data<actions::remove> {
         const std::string& anchor() const { return _anchor; }
 };
 
+/**
+ * @brief a list of identify, fetch and insert actions (possibly for different patients) authorized by a single challenge
+ * The actions are applied in order, each one appends a block to the active chain of the requester.
+ */
+template <>
+class action_data<actions::batch> {
+    public:
+        using data = std::variant<action_data<actions::identify>, action_data<actions::fetch>, action_data<actions::insert>>;
+        using collection = std::vector<data>;
+    private:
+        collection _actions;
+    public:
+        action_data() = default;
+        collection::const_iterator begin() const { return _actions.begin(); }
+        collection::const_iterator end() const { return _actions.end(); }
+        template <actions A>
+        void add(const action_data<A>& action) { _actions.emplace_back(action); }
+        std::size_t count() const { return _actions.size(); }
+};
+
 template <actions A, typename... Args>
 action_data<A> action(const Args&... args){
     return action_data<A>(args...);
@@ -125,18 +149,23 @@ action_data<A> action(const Args&... args){
 struct header{
     std::uint8_t  type;
     std::uint32_t size;
+    std::uint32_t id;       ///< chosen by the client, the challenge and the result of an operation carry the id of its request
 
     inline header(): header(type::unknown) {}
-    explicit inline header(enum type t): type((std::uint8_t) t), size(0) {}
+    explicit inline header(enum type t, std::uint32_t i = 0): type((std::uint8_t) t), size(0), id(i) {}
 };
 
 struct request{
     std::string       last;     // \tau_{u}^{(0)}
     CryptoPP::Integer y;        // g^{\pi_{u}}
     CryptoPP::Integer token;    // g^{\pi_{u} r_{u}^{(0)}}
+    bool              resume = false;   ///< asks for a resumption ticket with the result
 
     static request construct(const cbtl::blocks::access& block, const cbtl::keys::identity::pair& keys);
-    static request construct(cbtl::storage& db, const cbtl::keys::identity::pair& keys);
+    template <typename StorageT>
+    static request construct(StorageT& db, const cbtl::keys::identity::pair& keys){
+        return construct(cbtl::blocks::last::active(db, keys.pub(), keys.pri()), keys);
+    }
 };
 
 void to_json(nlohmann::json& j, const request& q);
@@ -180,38 +209,62 @@ response<ActionT> respond(const ActionT& action, const cbtl::keys::identity::pri
     return response<ActionT>(action, pri, access, lambda);
 }
 
+/**
+ * @brief a response sent along with a resumption ticket instead of answering a challenge
+ * The response is prepared with the lambda that came with the ticket, the proof shows that the sender could unmask that lambda.
+ */
+struct resumption{
+    std::string    ticket;
+    std::string    proof;
+    nlohmann::json response;
+
+    static std::string prove(const std::string& ticket, const CryptoPP::Integer& lambda);
+};
+
+void to_json(nlohmann::json& j, const resumption& r);
+void from_json(const nlohmann::json& j, resumption& r);
+
 // void to_json(nlohmann::json& j, const response& res);
 // void from_json(const nlohmann::json& j, response& res);
 
-template <typename DataT>
-struct envelop{
+/**
+ * @brief a serialized frame, header and body are kept apart and sent as a two buffer gather
+ */
+struct basic_envelop{
     header _head;
-    DataT  _data;
     std::string _serialized;
 
-    explicit envelop(enum type t, const DataT& d): _head(t), _data(d) {
-        _serialized = serialize();
+    basic_envelop(enum type t, std::string&& serialized, std::uint32_t id = 0): _head(t, htonl(id)), _serialized(std::move(serialized)) {
         _head.size = htonl(_serialized.size());
     }
-    std::string serialize() const {
-        nlohmann::json data = _data;
-        return data.dump();
+    std::array<boost::asio::const_buffer, 2> buffers() const {
+        return { boost::asio::buffer(&_head, sizeof(_head)), boost::asio::buffer(_serialized) };
     }
-    const DataT& data() const { return _data; }
     template <typename IteratorT>
     void copy(IteratorT begin){
-        std::uint8_t* h = reinterpret_cast<std::uint8_t*>(&_head);
+        const std::uint8_t* h = reinterpret_cast<const std::uint8_t*>(&_head);
         IteratorT it = std::copy_n(h, sizeof(_head), begin);
         std::copy(_serialized.cbegin(), _serialized.cend(), it);
     }
     template <typename SocketT>
     std::size_t write(SocketT& socket){
-        std::vector<std::uint8_t> buffer;
-        copy(std::back_inserter(buffer));
-        std::size_t written = boost::asio::write(socket, boost::asio::buffer(buffer.data(), buffer.size()));
-        buffer.clear();
-        return written;
+        return boost::asio::write(socket, buffers());
+    }
+};
+
+template <typename DataT>
+struct envelop: basic_envelop{
+    DataT  _data;
+
+    explicit envelop(enum type t, const DataT& d, std::uint32_t id = 0): basic_envelop(t, serialize(d), id), _data(d) { }
+    static std::string serialize(const DataT& d) {
+        nlohmann::json data = d;
+        return data.dump();
+    }
+    std::string serialize() const {
+        return serialize(_data);
     }
+    const DataT& data() const { return _data; }
 };
 
 struct result{
@@ -223,6 +276,10 @@ struct result{
    nlohmann::json    aux;
 
    static result failure(std::uint32_t code, const std::string& reason);
+   /**
+    * @brief 503, the server is overloaded and the client should retry after the given number of seconds
+    */
+   static result busy(std::uint32_t retry_after);
    static result success(const CryptoPP::Integer& active, const CryptoPP::Integer& passive, const std::string& block, const nlohmann::json& aux);
    // static result success(const CryptoPP::Integer& passive, const std::string& block, const nlohmann::json& aux);
 };
@@ -300,6 +357,36 @@ namespace nlohmann {
         }
     };
 
+    template <>
+    struct adl_serializer<cbtl::packets::action_data<cbtl::packets::actions::batch>>{
+        static cbtl::packets::action_data<cbtl::packets::actions::batch> from_json(const json& j) {
+            cbtl::packets::action_data<cbtl::packets::actions::batch> batch;
+            for(const json& action: j["actions"]){
+                cbtl::packets::actions type = static_cast<cbtl::packets::actions>(action["type"].get<std::uint32_t>());
+                if(type == cbtl::packets::actions::identify){
+                    batch.add(action.get<cbtl::packets::action_data<cbtl::packets::actions::identify>>());
+                }else if(type == cbtl::packets::actions::fetch){
+                    batch.add(action.get<cbtl::packets::action_data<cbtl::packets::actions::fetch>>());
+                }else if(type == cbtl::packets::actions::insert){
+                    batch.add(action.get<cbtl::packets::action_data<cbtl::packets::actions::insert>>());
+                }else{
+                    throw std::invalid_argument("action type not allowed in a batch");
+                }
+            }
+            return batch;
+        }
+        static void to_json(json& j, const cbtl::packets::action_data<cbtl::packets::actions::batch>& res) {
+            nlohmann::json actions = nlohmann::json::array();
+            for(auto i = res.begin(); i != res.end(); ++i){
+                std::visit([&actions](const auto& action){ actions.push_back(action); }, *i);
+            }
+            j = nlohmann::json {
+                {"type", static_cast<std::uint32_t>(cbtl::packets::actions::batch)},
+                {"actions", actions}
+            };
+        }
+    };
+
     template <typename ActionT>
     struct adl_serializer<cbtl::packets::response<ActionT>> {
         static cbtl::packets::response<ActionT> from_json(const json& j) {
@@ -0,0 +1,185 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef cbtl_STORAGE_REDIS_ASYNC_H
+#define cbtl_STORAGE_REDIS_ASYNC_H
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <optional>
+#include <functional>
+#include <type_traits>
+#include <boost/noncopyable.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/system/error_code.hpp>
+#include <hiredis/hiredis.h>
+#include <hiredis/async.h>
+#include "cbtl/blocks/access.h"
+#include "cbtl/compression.h"
+#include "cbtl/redis-keys.h"
+
+namespace cbtl{
+
+/**
+ * @brief redis backed block storage driven by the asio event loop
+ * The hiredis async context is attached to the io_context through a stream_descriptor on its socket, so a command
+ * only costs the reactor the time to queue it and many lookups may be in flight on one connection.
+ * The async_ functions take any asio completion token (e.g. use_awaitable), the handler is invoked on its associated
+ * executor. The storage has to outlive the io_context it runs on.
+ * A lost connection is reopened on the strand with exponential backoff, until then the commands fail with
+ * not_connected and connected() is false, so that the engine answers through its blocking pool instead.
+ * With compact address keys async_exists(id, true) and async_id may answer for another address sharing the key, so
+ * engines::redis never hands out an async_storage for address lookups then and checks the block synchronously.
+ */
+class async_storage: private boost::noncopyable{
+  public:
+    using strand_type = boost::asio::strand<boost::asio::io_context::executor_type>;
+  private:
+    struct pending{
+        virtual ~pending() = default;
+        virtual void complete(redisReply* reply) = 0;
+    };
+    template <typename HandlerT, typename ResultT>
+    struct operation: pending{
+        using convert_type  = std::function<std::pair<boost::system::error_code, ResultT> (redisReply*)>;
+        using executor_type = boost::asio::associated_executor_t<HandlerT, strand_type>;
+
+        HandlerT     _handler;
+        convert_type _convert;
+        boost::asio::executor_work_guard<executor_type> _work;
+
+        operation(HandlerT&& handler, convert_type convert, const strand_type& strand): _handler(std::move(handler)), _convert(std::move(convert)), _work(boost::asio::get_associated_executor(_handler, strand)) {}
+        void complete(redisReply* reply) override {
+            // the reply is freed by hiredis once the callback returns, so it is converted right away
+            std::pair<boost::system::error_code, ResultT> result = _convert(reply);
+            executor_type executor = _work.get_executor();
+            boost::asio::post(executor, [handler = std::move(_handler), result = std::move(result)]() mutable {
+                handler(result.first, std::move(result.second));
+            });
+            _work.reset();
+        }
+    };
+  public:
+    /**
+     * @brief the blocks are stored and read through the compressor and keys of the engine, which have to outlive the storage
+     */
+    async_storage(boost::asio::io_context& io, cbtl::compressor& compressor, const cbtl::redis_keys& keys, const std::string& host = "127.0.0.1", int port = 6379);
+    /**
+     * @brief frees the hiredis context on the strand, the io_context has to be either running or stopped
+     */
+    ~async_storage();
+
+    /**
+     * @brief false while the connection is being (re)established
+     */
+    bool connected() const { return _connected.load(); }
+
+    /**
+     * @brief completion signature void(boost::system::error_code, bool)
+     */
+    template <typename CompletionToken>
+    auto async_exists(const std::string& id, bool index, CompletionToken&& token){
+        return boost::asio::async_initiate<CompletionToken, void(boost::system::error_code, bool)>([this](auto handler, std::vector<std::string> args){
+            execute(std::move(args), std::move(handler), &async_storage::to_bool);
+        }, token, std::vector<std::string>{"EXISTS", index ? _keys.address(id) : _keys.block(id)});
+    }
+    /**
+     * @brief completion signature void(boost::system::error_code, std::string), not_found if the address is not indexed
+     */
+    template <typename CompletionToken>
+    auto async_id(const std::string& addr, CompletionToken&& token){
+        return boost::asio::async_initiate<CompletionToken, void(boost::system::error_code, std::string)>([this](auto handler, std::vector<std::string> args){
+            execute(std::move(args), std::move(handler), [this](redisReply* reply){ return to_id(reply); });
+        }, token, std::vector<std::string>{"GET", _keys.address(addr)});
+    }
+    /**
+     * @brief completion signature void(boost::system::error_code, std::optional<cbtl::blocks::access>), not_found if there is no such block
+     */
+    template <typename CompletionToken>
+    auto async_fetch(const std::string& block_id, CompletionToken&& token){
+        return boost::asio::async_initiate<CompletionToken, void(boost::system::error_code, std::optional<cbtl::blocks::access>)>([this](auto handler, std::vector<std::string> args){
+            execute(std::move(args), std::move(handler), [this](redisReply* reply){ return to_block(reply); });
+        }, token, std::vector<std::string>{"GET", _keys.block(block_id)});
+    }
+    /**
+     * @brief completion signature void(boost::system::error_code, bool), false if the block or either of its addresses already exists
+     */
+    template <typename CompletionToken>
+    auto async_add(const cbtl::blocks::access& block, CompletionToken&& token){
+        return boost::asio::async_initiate<CompletionToken, void(boost::system::error_code, bool)>([this](auto handler, std::vector<std::string> args){
+            execute(std::move(args), std::move(handler), &async_storage::to_bool);
+        }, token, add_command(block));
+    }
+  private:
+    template <typename HandlerT, typename ConvertT>
+    void execute(std::vector<std::string> args, HandlerT&& handler, ConvertT convert){
+        using result_type    = typename std::invoke_result_t<ConvertT, redisReply*>::second_type;
+        using operation_type = operation<std::decay_t<HandlerT>, result_type>;
+        std::unique_ptr<pending> op = std::make_unique<operation_type>(std::forward<HandlerT>(handler), std::move(convert), _strand);
+        boost::asio::post(_strand, [this, args = std::move(args), op = std::move(op)]() mutable {
+            submit(args, std::move(op));
+        });
+    }
+    void submit(const std::vector<std::string>& args, std::unique_ptr<pending> op);
+
+    std::vector<std::string> add_command(const cbtl::blocks::access& block);
+    static std::pair<boost::system::error_code, bool> to_bool(redisReply* reply);
+    static std::pair<boost::system::error_code, std::string> to_string(redisReply* reply);
+    std::pair<boost::system::error_code, std::string> to_id(redisReply* reply);
+    std::pair<boost::system::error_code, std::optional<cbtl::blocks::access>> to_block(redisReply* reply);
+
+    // hiredis event hooks, data is the async_storage
+    static void on_reply(redisAsyncContext* context, void* reply, void* data);
+    static void on_connect(const redisAsyncContext* context, int status);
+    static void on_disconnect(const redisAsyncContext* context, int status);
+    static void add_read(void* data);
+    static void del_read(void* data);
+    static void add_write(void* data);
+    static void del_write(void* data);
+    static void cleanup(void* data);
+
+    /**
+     * @brief opens a new hiredis context, throws std::runtime_error if it cannot even be allocated
+     */
+    void connect();
+    /**
+     * @brief schedules connect() after the backoff, on the strand
+     */
+    void reconnect();
+    void close();
+    void arm_read();
+    void arm_write();
+  private:
+    cbtl::compressor&                       _compressor;
+    const cbtl::redis_keys&                 _keys;
+    std::string                             _host;
+    int                                     _port;
+    strand_type                             _strand;
+    boost::asio::posix::stream_descriptor   _descriptor;
+    boost::asio::steady_timer               _retry;
+    std::chrono::milliseconds               _backoff;
+    redisAsyncContext*                      _context;
+    std::size_t                             _generation;   ///< connections opened, waits armed for an earlier one are ignored
+    bool                                    _closing;
+    bool                                    _retrying;
+    std::atomic<bool>                       _connected;
+    bool                                    _want_read;
+    bool                                    _want_write;
+    bool                                    _reading;
+    bool                                    _writing;
+};
+
+}
+
+#endif // cbtl_STORAGE_REDIS_ASYNC_H
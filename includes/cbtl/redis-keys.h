@@ -0,0 +1,56 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef cbtl_REDIS_KEYS_H
+#define cbtl_REDIS_KEYS_H
+
+#include <string>
+#include <optional>
+#include <string_view>
+
+namespace cbtl{
+
+/**
+ * @brief names of the redis keys of the ledger
+ * Block ids and addresses are hex everywhere else in cbtl, the keys (and the block ids stored under the address keys)
+ * hold their raw bytes instead, which halves their size. The keys are therefore binary and must be passed with %b.
+ * With a digest of n bytes an address key only holds the first n bytes of SHA-256 of the address. Two addresses may
+ * then share a key, so whoever reads a block through an address key has to check that the block has that address.
+ */
+class redis_keys{
+    std::size_t _digest;   ///< 0 for full address keys
+  public:
+    /**
+     * @brief throws std::invalid_argument unless digest is 0 (full keys) or between 8 and 32
+     */
+    explicit redis_keys(std::size_t digest = 0);
+    bool compact() const { return _digest > 0; }
+
+    /**
+     * @brief id:<raw block id>
+     */
+    std::string block(const std::string& block_id) const;
+    /**
+     * @brief addr:<raw address> or addr:<truncated SHA-256 of the raw address>
+     */
+    std::string address(const std::string& address) const;
+    /**
+     * @brief the value of the address keys of the block
+     */
+    std::string value(const std::string& block_id) const { return raw(block_id); }
+    /**
+     * @brief the hex block id of the value of an address key
+     */
+    std::string id(std::string_view value) const { return hex(value); }
+    /**
+     * @brief the hex address of an address key, nullopt for compact keys which do not hold the address
+     */
+    std::optional<std::string> address_of(std::string_view key) const;
+
+    static std::string raw(std::string_view hex);
+    static std::string hex(std::string_view raw);
+};
+
+}
+
+#endif // cbtl_REDIS_KEYS_H
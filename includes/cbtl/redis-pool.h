@@ -0,0 +1,76 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef cbtl_REDIS_POOL_H
+#define cbtl_REDIS_POOL_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#include <hiredis/hiredis.h>
+
+namespace cbtl{
+
+/**
+ * @brief bounded pool of blocking redis connections shared by threads
+ * A connection is checked out for the duration of one command (or one pipeline) and returned when its lease is destroyed.
+ * Connections are opened lazily up to the capacity, after that checkout() waits for a connection to be returned.
+ * A connection that has been idle for longer than the health interval is PINGed before it is handed out, and a
+ * connection found broken is dropped so that the next checkout opens a fresh one.
+ */
+class redis_pool{
+  public:
+    using clock_type = std::chrono::steady_clock;
+    class lease{
+        redis_pool*   _pool;
+        redisContext* _context;
+        bool          _broken;
+      public:
+        lease(redis_pool& pool, redisContext* context): _pool(&pool), _context(context), _broken(false) {}
+        lease(lease&& other) noexcept: _pool(other._pool), _context(other._context), _broken(other._broken) { other._context = 0x0; }
+        lease(const lease&) = delete;
+        lease& operator=(const lease&) = delete;
+        ~lease() { if(_context) _pool->release(_context, _broken); }
+        redisContext* get() const { return _context; }
+        redisContext* operator->() const { return _context; }
+        /**
+         * @brief closes the connection instead of pooling it when the lease ends, e.g. if replies may be left unread
+         */
+        void discard() { _broken = true; }
+    };
+  private:
+    struct idle{
+        redisContext*          context;
+        clock_type::time_point since;
+    };
+    std::string              _host;
+    int                      _port;
+    std::size_t              _capacity;
+    std::chrono::seconds     _health;
+    std::size_t              _open;      ///< connections open, idle or leased
+    std::vector<idle>        _idle;
+    std::mutex               _mutex;
+    std::condition_variable  _returned;
+  public:
+    explicit redis_pool(std::size_t capacity, const std::string& host = "127.0.0.1", int port = 6379, std::chrono::seconds health = std::chrono::seconds(30));
+    ~redis_pool();
+    /**
+     * @brief a healthy connection, blocks while all capacity connections are leased, throws std::runtime_error if a connection cannot be opened
+     */
+    lease checkout();
+    /**
+     * @brief closes the idle connections, leased connections stay open and are pooled again when returned
+     */
+    void clear();
+    std::size_t capacity() const { return _capacity; }
+  private:
+    void release(redisContext* context, bool broken);
+    static redisContext* connect(const std::string& host, int port);
+    static bool healthy(redisContext* context);
+};
+
+}
+
+#endif // cbtl_REDIS_POOL_H
@@ -0,0 +1,57 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef cbtl_REDIS_RING_H
+#define cbtl_REDIS_RING_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <string_view>
+
+namespace cbtl{
+
+/**
+ * @brief consistent hash ring over the redis shards of the ledger
+ * Every shard is placed at replicas points of a 64 bit ring, derived from its host:port only, and a key belongs to the
+ * first point at or after its hash. Adding a shard therefore only moves the keys that fall to the new shard's points.
+ * Keys are routed by the block id (id:) or the address (addr:) without the prefix, see route().
+ */
+class redis_ring{
+  public:
+    static constexpr std::size_t replicas = 160;
+    struct endpoint{
+        std::string host;
+        int         port;
+
+        std::string str() const { return host + ":" + std::to_string(port); }
+        /**
+         * @brief host:port or host (port 6379), throws std::invalid_argument on a malformed port
+         */
+        static endpoint parse(const std::string& str);
+    };
+  private:
+    std::vector<endpoint>                             _endpoints;
+    std::vector<std::pair<std::uint64_t, std::size_t>> _points;   ///< (position, shard) sorted by position
+  public:
+    /**
+     * @brief throws std::invalid_argument if there is no endpoint
+     */
+    explicit redis_ring(const std::vector<std::string>& endpoints);
+    /**
+     * @brief the shard the block id or address belongs to
+     */
+    std::size_t locate(std::string_view key) const;
+    std::size_t size() const { return _endpoints.size(); }
+    const endpoint& at(std::size_t shard) const { return _endpoints.at(shard); }
+    /**
+     * @brief the part of a redis key (id:<block id> or addr:<address>) it is routed by
+     */
+    static std::string_view route(std::string_view key);
+    static std::uint64_t hash(std::string_view key);
+};
+
+}
+
+#endif // cbtl_REDIS_RING_H
@@ -5,33 +5,113 @@
 #define cbtl_STORAGE_REDIS_H
 
 #include <string>
+#include <vector>
+#include <memory>
+#include <optional>
+#include <functional>
+#include <mutex>
 #include <hiredis/hiredis.h>
+#include <boost/asio/io_context.hpp>
+#include "cbtl/redis-pool.h"
+#include "cbtl/redis-ring.h"
+#include "cbtl/redis-keys.h"
+#include "cbtl/redis-async-storage.h"
+#include "cbtl/config.h"
+#include "cbtl/compression.h"
 #include "cbtl/blocks_fwd.h"
 #include <cryptopp/integer.h>
 
 namespace cbtl{
+namespace engines{
 
-struct storage{
-    storage();
-    ~storage();
+/**
+ * @brief redis storage engine, safe to be shared by concurrent sessions
+ * The keys are spread over the redis instances of config.redis by a consistent hash ring, each instance has its own
+ * bounded pool of config.connections, so that many commands run in parallel.
+ * Once attached to an io_context the engine also offers an async_storage per instance on the event loop.
+ * The keys hold raw bytes (see redis_keys), with config.address_digest the address keys are truncated digests.
+ */
+class redis{
+  public:
+    explicit redis(const cbtl::config& config);
+    ~redis();
 
+    /**
+     * @brief writes the block and its addresses, false if the block or either address already exists
+     * The keys are written with one MSETNX per shard they belong to. If another shard refuses its part, the keys already
+     * written are deleted again on a best effort basis. A transport failure during the write can leave partial keys
+     * behind, for a rerun or cbtl-rebalance to find.
+     */
     bool add(const cbtl::blocks::access& block);
+    /**
+     * @brief writes all the blocks in one pipeline per shard, returns for each block whether it was written
+     */
+    std::vector<bool> add_batch(const std::vector<cbtl::blocks::access>& blocks);
     bool exists(const std::string& id, bool index = false);
 
     std::string id(const std::string& addr);
 
     cbtl::blocks::access fetch(const std::string& block_id);
 
+    /**
+     * @brief the block indexed by the address, nullopt if there is none
+     * With a single shard this is one round trip (a server side script does GET addr: and GET id:), otherwise the id is
+     * looked up on the shard of the address and the block on the shard of the id.
+     */
+    std::optional<cbtl::blocks::access> resolve(const std::string& address);
+
+    /**
+     * @brief calls f with every indexed address
+     */
+    void scan_addresses(const std::function<void (const std::string&)>& f);
+    /**
+     * @brief calls f with every stored block
+     */
+    void scan_blocks(const std::function<void (const cbtl::blocks::access&)>& f);
+    /**
+     * @brief compressor of the stored blocks
+     */
+    cbtl::compressor& compression() { return _compressor; }
+
+    void attach(boost::asio::io_context& io);
+    void detach();
+    /**
+     * @brief the async_storage of the shard the block id (or the address if index) belongs to
+     * null if not attached or while that async_storage is reconnecting, the caller then uses the blocking pool.
+     * Also null for addresses with compact keys, which only the blocking path checks against the address of the block.
+     */
+    cbtl::async_storage* async(const std::string& id, bool index = false) {
+        if(_async.empty() || (index && _keys.compact())){
+            return 0x0;
+        }
+        cbtl::async_storage* async = _async[_ring.locate(cbtl::redis_ring::route(index ? _keys.address(id) : _keys.block(id)))].get();
+        return async->connected() ? async : 0x0;
+    }
+    const cbtl::redis_ring& ring() const { return _ring; }
+
     protected:
         void open();
         void close();
+        /**
+         * @brief loads the resolve script into redis, returns its sha1
+         */
+        std::string load_script(redisContext* context);
+        /**
+         * @brief pool of the shard the key belongs to
+         */
+        cbtl::redis_pool& pool(const std::string& key) { return *_pools[_ring.locate(cbtl::redis_ring::route(key))]; }
 
     private:
-        redisContext* _context;
-        bool _opened;
+        cbtl::compressor                                   _compressor;
+        cbtl::redis_keys                                   _keys;
+        cbtl::redis_ring                                   _ring;
+        std::vector<std::unique_ptr<cbtl::redis_pool>>     _pools;   ///< one per shard
+        std::vector<std::unique_ptr<cbtl::async_storage>>  _async;   ///< one per shard once attached
+        std::string                                        _resolve_sha;
+        std::mutex                                         _script_mutex;
 };
 
+}
 }
 
 #endif // cbtl_STORAGE_REDIS_H
-
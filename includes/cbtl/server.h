@@ -16,34 +16,67 @@
 #include <boost/lexical_cast.hpp>
 #include <boost/asio/signal_set.hpp>
 #include <boost/asio/io_service.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/asio/thread_pool.hpp>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <csignal>
+#include "cbtl/config.h"
+#include "cbtl/admission.h"
+#include "cbtl/tips.h"
+#include "cbtl/combiner.h"
 #include "cbtl/session.h"
 #include "cbtl/keys.h"
-#include "cbtl/redis-storage.h"
+#include "cbtl/ledger.h"
 
 namespace cbtl{
 
 class server: public boost::enable_shared_from_this<server>, private boost::noncopyable{
-#if (BOOST_VERSION / 1000 >=1 && BOOST_VERSION / 100 % 1000 >= 70)
-    typedef boost::asio::basic_stream_socket<boost::asio::ip::tcp, boost::asio::io_context::executor_type> socket_type;
-#else
-    typedef boost::asio::basic_stream_socket<boost::asio::ip::tcp> socket_type;
-#endif
+    typedef boost::asio::strand<boost::asio::io_context::executor_type> strand_type;
+    typedef boost::asio::basic_stream_socket<boost::asio::ip::tcp, strand_type> socket_type;
+    typedef boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> reuse_port;
   private:
     boost::asio::io_service&        _io;
     boost::asio::ip::tcp::acceptor  _acceptor;
-    socket_type                     _socket;
     boost::asio::signal_set         _signals;
-    cbtl::storage&                   _db;
+    cbtl::ledger&                    _db;
     cbtl::keys::identity::pair       _master;
     cbtl::keys::view_key             _view;
+    cbtl::config                     _config;
+    cbtl::admission                  _admission;
+    cbtl::tip_cache                  _tips;
+    cbtl::write_combiner<cbtl::ledger> _writes;
+    std::vector<std::thread>        _threads;
+    boost::asio::thread_pool        _compute;
   public:
-    server(cbtl::storage& db, const cbtl::keys::identity::pair& master, const cbtl::keys::view_key& view, boost::asio::io_service& io, std::uint32_t port);
-    server(cbtl::storage& db, const cbtl::keys::identity::pair& master, const cbtl::keys::view_key& view, boost::asio::io_service& io, const boost::asio::ip::tcp::endpoint& endpoint);
+    server(cbtl::ledger& db, const cbtl::keys::identity::pair& master, const cbtl::keys::view_key& view, const cbtl::config& config, boost::asio::io_service& io, std::uint32_t port);
+    server(cbtl::ledger& db, const cbtl::keys::identity::pair& master, const cbtl::keys::view_key& view, const cbtl::config& config, boost::asio::io_service& io, const boost::asio::ip::tcp::endpoint& endpoint);
     ~server() noexcept;
+    /**
+     * @brief forks workers - 1 processes, returns the pids of the children in the parent and an empty list in the children
+     * Must be called before any io_context, thread or storage connection is created. Each worker binds the same port
+     * with SO_REUSEPORT and the kernel balances the incoming connections across them.
+     */
+    static std::vector<pid_t> fork(std::size_t workers);
+    /**
+     * @brief stops the children forked by fork() and waits for them
+     */
+    static void reap(const std::vector<pid_t>& children);
     void stop();
+    /**
+     * @brief starts accepting and runs the io_context on config.threads threads, blocks until the server is stopped
+     */
     void run();
     void accept();
-    void on_accept(boost::system::error_code ec);
+    void on_accept(boost::system::error_code ec, socket_type socket);
+  private:
+    /**
+     * @brief tells the client that the server is busy and closes the connection
+     */
+    void refuse(socket_type socket);
 };
 
 
@@ -9,21 +9,34 @@
 #include <boost/noncopyable.hpp>
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/ip/tcp.hpp>
-#include <boost/bind/bind.hpp>
 #include <boost/array.hpp>
 #include <boost/format.hpp>
 #include <boost/asio/write.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/asio/strand.hpp>
-#include <boost/asio/bind_executor.hpp>
 #include <boost/asio/read.hpp>
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/use_awaitable.hpp>
 #include <boost/date_time/posix_time/ptime.hpp>
 #include <boost/date_time/posix_time/posix_time_io.hpp>
 #include <boost/date_time/posix_time/posix_time_types.hpp>
-#include <boost/asio/placeholders.hpp>
+#include <boost/asio/thread_pool.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <arpa/inet.h>
+#include <optional>
+#include <deque>
+#include <type_traits>
+#include <map>
 #include "cbtl/packets.h"
-#include "cbtl/redis-storage.h"
+#include "cbtl/buffers.h"
+#include "cbtl/config.h"
+#include "cbtl/tickets.h"
+#include "cbtl/admission.h"
+#include "cbtl/tips.h"
+#include "cbtl/combiner.h"
+#include "cbtl/ledger.h"
 #include "cbtl/keys.h"
 #include "cbtl/blocks/io.h"
 
@@ -31,74 +44,148 @@ namespace cbtl{
 
 
 
+/**
+ * @brief one connection to the Trusted Server
+ * Every frame is handled by its own coroutine on the session's strand, so a client may pipeline many
+ * request -> challenge -> response -> result exchanges over one connection, told apart by the header id.
+ * The cryptographic phases are awaited on the compute pool and results are sent as soon as they are ready.
+ * A client holding a resumption ticket sends its response straight away in a resume frame.
+ * Frames beyond the in-flight cap of the connection or the job cap of the server are answered with a busy result,
+ * and the connection is closed if the client stalls during the handshake or stays idle for too long.
+ */
 class session: public boost::enable_shared_from_this<session>, private boost::noncopyable{
   struct challenge_data{
     CryptoPP::Integer last;     // \tau_{u}^{(0)}
     CryptoPP::Integer y;        // g^{\pi_{u}}
     CryptoPP::Integer token;    // g^{\pi_{u} r_{u}^{(0)}}
-    bool challenged;
     CryptoPP::Integer forward;
     CryptoPP::Integer lambda;
+    CryptoPP::Integer shared;   // y^{x}
+    bool              resume;
     boost::posix_time::ptime requested;
-
-    inline challenge_data(): challenged(false) {}
+  };
+  struct pending_challenge{
+    challenge_data            data;
+    cbtl::packets::challenge  challenge;
+  };
+  struct frame{
+    cbtl::packets::type type;
+    std::uint32_t       id;
+    nlohmann::json      json;
   };
 
-#if (BOOST_VERSION / 1000 >=1 && BOOST_VERSION / 100 % 1000 >= 70)
-    typedef boost::asio::basic_stream_socket<boost::asio::ip::tcp, boost::asio::io_context::executor_type> socket_type;
-#else
-    typedef boost::asio::basic_stream_socket<boost::asio::ip::tcp> socket_type;
-#endif
+    typedef boost::asio::strand<boost::asio::io_context::executor_type> strand_type;
+    typedef boost::asio::basic_stream_socket<boost::asio::ip::tcp, strand_type> socket_type;
 
   private:
     using buffer_type = boost::array<std::uint8_t, sizeof(cbtl::packets::header)>;
     socket_type                     _socket;
     boost::posix_time::ptime        _time;
     buffer_type                     _header;
-    boost::array<char, 4096>        _data;
-    cbtl::packets::header            _head;
-    std::string                     _body;
-    cbtl::storage&                   _db;
+    cbtl::ledger&                    _db;
     cbtl::keys::identity::pair       _master;
     cbtl::keys::view_key             _view;
-    challenge_data                  _challenge_data;
+    const cbtl::config&              _config;
+    boost::asio::thread_pool&       _compute;
+    cbtl::tip_cache&                 _tips;
+    cbtl::write_combiner<cbtl::ledger>& _writes;
+    std::deque<cbtl::packets::basic_envelop> _outbound;
+    std::map<std::uint32_t, challenge_data> _challenges;   ///< outstanding challenges by request id
+    cbtl::ticket::key_type           _ticket_key;
+    cbtl::admission&                 _admission;
+    cbtl::admission::slot            _slot;
+    boost::asio::steady_timer        _deadline;
+    std::size_t                      _inflight;    ///< frames being handled
+    bool                             _greeted;     ///< at least one frame has been received
   public:
     typedef boost::shared_ptr<session> pointer;
-    static pointer create(cbtl::storage& db, const cbtl::keys::identity::pair& master, const cbtl::keys::view_key& view, socket_type socket);
+    static pointer create(cbtl::ledger& db, const cbtl::keys::identity::pair& master, const cbtl::keys::view_key& view, const cbtl::config& config, boost::asio::thread_pool& compute, cbtl::tip_cache& tips, cbtl::write_combiner<cbtl::ledger>& writes, cbtl::admission& admission, cbtl::admission::slot slot, socket_type socket);
     inline ~session() {}
   private:
-    explicit session(cbtl::storage& db, const cbtl::keys::identity::pair& master, const cbtl::keys::view_key& view, socket_type socket);
+    explicit session(cbtl::ledger& db, const cbtl::keys::identity::pair& master, const cbtl::keys::view_key& view, const cbtl::config& config, boost::asio::thread_pool& compute, cbtl::tip_cache& tips, cbtl::write_combiner<cbtl::ledger>& writes, cbtl::admission& admission, cbtl::admission::slot slot, socket_type socket);
   public:
+      /**
+       * @brief spawns the session coroutine on the session's strand
+       */
       void run();
-      void do_read();
-      void handle_read_header(const boost::system::error_code& error, std::size_t bytes_transferred);
-      void read_more(const boost::system::error_code& error, std::size_t bytes_transferred);
-      void read_finished();
-      // void handle_storage_data(const boost::system::error_code& error, std::size_t bytes_transferred);
-      void write_handler();
+      /**
+       * @brief queues the frame for an asynchronous write, frames are sent in the order they are queued
+       */
+      void send(cbtl::packets::basic_envelop&& envelop);
+      template <typename DataT>
+      void send(cbtl::packets::type type, const DataT& data, std::uint32_t id){
+        send(cbtl::packets::basic_envelop(type, cbtl::packets::envelop<DataT>::serialize(data), id));
+      }
       inline socket_type& socket(){ return _socket; }
   private:
-      void handle_request(const cbtl::packets::request& req);
-      // CryptoPP::Integer handle_challenge_response(const cbtl::packets::basic_response& response);
+      boost::asio::awaitable<void> serve();
+      boost::asio::awaitable<void> handle(frame f);
+      /**
+       * @brief checks that the active chain has not moved past the challenge, then verifies the response and applies its action
+       */
+      boost::asio::awaitable<void> answer(std::uint32_t id, const nlohmann::json& response, challenge_data challenge);
+      /**
+       * @brief reads the next frame, the json is null if the body could not be parsed
+       */
+      boost::asio::awaitable<frame> read();
+      boost::asio::awaitable<void> flush();
+      /**
+       * @brief closes the connection once the deadline passes
+       */
+      boost::asio::awaitable<void> watch();
+      /**
+       * @brief moves the deadline, no deadline while frames are being handled
+       */
+      void rearm();
+      void close();
+      /**
+       * @brief runs work on the compute pool, the awaiting coroutine resumes on the session's strand
+       */
+      template <typename WorkT>
+      boost::asio::awaitable<std::invoke_result_t<WorkT>> compute(WorkT work){
+        using result_type = std::invoke_result_t<WorkT>;
+        co_return co_await boost::asio::co_spawn(
+            _compute.get_executor(),
+            [work = std::move(work)]() mutable -> boost::asio::awaitable<result_type> { co_return work(); },
+            boost::asio::use_awaitable
+        );
+      }
+      std::optional<pending_challenge> handle_request(const cbtl::packets::request& req, const cbtl::blocks::access& last);
+      /**
+       * @brief verifies the response and applies its action, challenge is advanced to the tip of the active chain
+       */
+      cbtl::packets::result respond(const nlohmann::json& req_json, challenge_data& challenge);
+      /**
+       * @brief opens the ticket in place of a challenge, returns the failure to send if the ticket is not acceptable
+       */
+      std::optional<cbtl::packets::result> redeem(const cbtl::packets::resumption& resumption, challenge_data& challenge);
+      /**
+       * @brief attaches a resumption ticket for the current tip of the active chain to a successful result if one was asked for
+       */
+      void issue(cbtl::packets::result& result, const challenge_data& challenge);
       template <typename ActionDataT>
-      cbtl::packets::result stage2(const cbtl::packets::response<ActionDataT>& response){
-        CryptoPP::Integer gaccess = verify(response);
+      cbtl::packets::result stage2(const cbtl::packets::response<ActionDataT>& response, challenge_data& challenge){
+        CryptoPP::Integer gaccess = verify(response, challenge);
         if(!gaccess.IsZero()){
-          cbtl::packets::result result = process(response.action(), gaccess);
-          cbtl::packets::envelop<cbtl::packets::result> envelop(cbtl::packets::type::result, result);
-          std::size_t bytes = envelop.write(_socket);
-          // std::cout << bytes << " sent" << std::endl;
-          return result;
+          return process(response.action(), gaccess, challenge);
         }
         return cbtl::packets::result::failure(0, "gaccess verification failed");
       }
   private:
-      cbtl::packets::result process(const cbtl::packets::action_data<cbtl::packets::actions::insert>& action, const CryptoPP::Integer& gaccess);
-      cbtl::packets::result process(const cbtl::packets::action_data<cbtl::packets::actions::identify>& action, const CryptoPP::Integer& gaccess);
-      cbtl::packets::result process(const cbtl::packets::action_data<cbtl::packets::actions::fetch>& action, const CryptoPP::Integer& gaccess);
-      cbtl::packets::result process(const cbtl::packets::action_data<cbtl::packets::actions::remove>& action, const CryptoPP::Integer& gaccess);
-      CryptoPP::Integer verify(const cbtl::packets::basic_response& response);
-      cbtl::blocks::access make(const cbtl::keys::identity::public_key& passive_pub, const CryptoPP::Integer& gaccess, const nlohmann::json& contents);
+      cbtl::packets::result process(const cbtl::packets::action_data<cbtl::packets::actions::insert>& action, const CryptoPP::Integer& gaccess, challenge_data& challenge);
+      cbtl::packets::result process(const cbtl::packets::action_data<cbtl::packets::actions::identify>& action, const CryptoPP::Integer& gaccess, challenge_data& challenge);
+      cbtl::packets::result process(const cbtl::packets::action_data<cbtl::packets::actions::fetch>& action, const CryptoPP::Integer& gaccess, challenge_data& challenge);
+      cbtl::packets::result process(const cbtl::packets::action_data<cbtl::packets::actions::remove>& action, const CryptoPP::Integer& gaccess, challenge_data& challenge);
+      cbtl::packets::result process(const cbtl::packets::action_data<cbtl::packets::actions::batch>& action, const CryptoPP::Integer& gaccess, challenge_data& challenge);
+      CryptoPP::Integer verify(const cbtl::packets::basic_response& response, const challenge_data& challenge);
+      /**
+       * @brief constructs the next block of the active chain, next is set to the token that extends the chain after it
+       */
+      cbtl::blocks::access make(const cbtl::keys::identity::public_key& passive_pub, const CryptoPP::Integer& gaccess, const nlohmann::json& contents, const challenge_data& challenge, CryptoPP::Integer& next);
+      /**
+       * @brief adds the block unless it already exists and advances challenge to it
+       */
+      bool append(const cbtl::blocks::access& block, const CryptoPP::Integer& next, challenge_data& challenge, const std::string& tip);
 };
 
 }
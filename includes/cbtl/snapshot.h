@@ -0,0 +1,81 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef cbtl_SNAPSHOT_H
+#define cbtl_SNAPSHOT_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <fstream>
+#include <string_view>
+#include <boost/noncopyable.hpp>
+#include "cbtl/blocks_fwd.h"
+
+namespace cbtl{
+
+/**
+ * @brief ledger snapshot file written by cbtl-dump and read by cbtl-load
+ * Layout (all numbers big-endian):
+ *   magic "CBTLSNAP" | version u32 | count u64
+ *   count records, each as u32 length | u32 crc32 of the block | block in the binary codec encoding (uncompressed)
+ * The address index is not stored, both addresses of a block are part of its encoding and storage::add_batch indexes them.
+ * The file is read through a read only memory map, so records are located without copying them.
+ */
+namespace snapshot{
+    constexpr std::uint32_t version = 1;
+
+    class writer: private boost::noncopyable{
+        std::ofstream _out;
+        std::string   _path;
+        std::uint64_t _count;
+      public:
+        /**
+         * @brief throws std::runtime_error if the file cannot be created
+         */
+        explicit writer(const std::string& path);
+        /**
+         * @brief removes the file if close() was not called, an unfinished snapshot is never left behind
+         */
+        ~writer();
+        void write(const cbtl::blocks::access& block);
+        /**
+         * @brief writes the record count into the header and closes the file
+         */
+        void close();
+        std::uint64_t count() const { return _count; }
+    };
+
+    class reader: private boost::noncopyable{
+      public:
+        struct record{
+            std::string_view data;
+            std::uint32_t    checksum;
+
+            bool valid() const;
+            /**
+             * @brief throws std::runtime_error if the checksum does not match
+             */
+            cbtl::blocks::access block() const;
+        };
+      private:
+        const char*   _data;
+        std::size_t   _size;
+        std::uint64_t _count;
+      public:
+        /**
+         * @brief maps the file, throws std::runtime_error if it cannot be mapped or is not a snapshot
+         */
+        explicit reader(const std::string& path);
+        ~reader();
+        std::uint64_t count() const { return _count; }
+        /**
+         * @brief locates all the records, throws std::runtime_error if the file is truncated
+         */
+        std::vector<record> records() const;
+    };
+}
+
+}
+
+#endif // cbtl_SNAPSHOT_H
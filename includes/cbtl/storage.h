@@ -5,37 +5,231 @@
 #define cbtl_STORAGE_H
 
 #include <string>
+#include <vector>
+#include <memory>
+#include <optional>
+#include <functional>
+#include <algorithm>
+#include <stdexcept>
+#include <boost/noncopyable.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/bind_executor.hpp>
+#include <boost/asio/associated_executor.hpp>
+#include <boost/system/error_code.hpp>
 #include "cbtl/blocks_fwd.h"
 #include "cbtl/blocks.h"
+#include "cbtl/config.h"
+#include "cbtl/cache.h"
+#include "cbtl/bloom.h"
+#include "cbtl/compression.h"
 #include <cryptopp/integer.h>
 
 namespace cbtl{
 
 /**
- * @todo write docs
+ * @brief block storage on top of an engine (engines::redis, engines::bdb, engines::lmdb, engines::memory or engines::any)
+ * An engine is constructed from the config and provides add, add_batch, exists, id, fetch, resolve, scan_addresses, scan_blocks and compression.
+ * The storage keeps the decoded blocks in an LRU cache and optionally a bloom filter over the address index in front of it.
+ * The async_ functions complete on the handler's executor. An engine with an event loop driven client
+ * (attach(io) and async(id, index), the client of the shard the block id or address belongs to) serves them without blocking, the other engines answer them synchronously.
  */
 template <typename EngineT>
-class storage{
+class storage: private boost::noncopyable{
+  public:
     using engine_type = EngineT;
 
-    storage(engine_type&& engine): _engine(engine) {}
+    explicit storage(const cbtl::config& config): _engine(config), _cache(config.cache_blocks) {}
     ~storage() {}
 
+    /**
+     * @brief writes the block and its addresses, false if the block or either address already exists
+     */
     bool add(const cbtl::blocks::access& block){
-        return _engine.add(block);
+        remember(block);
+        bool ok = _engine.add(block);
+        if(ok){
+            _cache.put(block.address().hash(), block);
+        }
+        return ok;
+    }
+    /**
+     * @brief writes all the blocks, returns for each block whether it was written
+     */
+    std::vector<bool> add_batch(const std::vector<cbtl::blocks::access>& blocks){
+        for(const cbtl::blocks::access& block: blocks){
+            remember(block);
+        }
+        std::vector<bool> ok = _engine.add_batch(blocks);
+        for(std::size_t i = 0; i < blocks.size(); ++i){
+            if(ok[i]){
+                _cache.put(blocks[i].address().hash(), blocks[i]);
+            }
+        }
+        return ok;
     }
     bool exists(const std::string& id, bool index = false){
+        if(!index && _cache.contains(id)){
+            return true;
+        }
+        if(index && _filter && !_filter->possibly(id)){
+            return false;
+        }
         return _engine.exists(id, index);
     }
     std::string id(const std::string& addr){
         return _engine.id(addr);
     }
     cbtl::blocks::access fetch(const std::string& block_id){
-        return _engine.fetch(block_id);
+        if(std::optional<cbtl::blocks::access> cached = _cache.get(block_id)){
+            return std::move(*cached);
+        }
+        cbtl::blocks::access block = _engine.fetch(block_id);
+        _cache.put(block_id, block);
+        return block;
+    }
+    /**
+     * @brief the block indexed by the address, nullopt if there is none, i.e. exists(address, true), id(address) and fetch() in one lookup
+     */
+    std::optional<cbtl::blocks::access> resolve(const std::string& address){
+        if(_filter && !_filter->possibly(address)){
+            return std::nullopt;
+        }
+        std::optional<cbtl::blocks::access> block = _engine.resolve(address);
+        if(block){
+            _cache.put(block->address().hash(), *block);
+        }
+        return block;
+    }
+
+    /**
+     * @brief loads the address index into a bloom filter, after which exists(address, true) answers definite misses locally
+     * The filter only sees the addresses written through this storage, so it must not be used while another process writes blocks.
+     */
+    void track(std::size_t expected, double rate = 0.01){
+        std::vector<std::string> addresses;
+        _engine.scan_addresses([&addresses](const std::string& address){
+            addresses.push_back(address);
+        });
+        std::unique_ptr<cbtl::bloom_filter> filter = std::make_unique<cbtl::bloom_filter>(std::max(expected, 2 * addresses.size()), rate);
+        for(const std::string& address: addresses){
+            filter->insert(address);
+        }
+        _filter = std::move(filter);
+    }
+    /**
+     * @brief calls f with every stored block, bypassing the cache, f must not write to the storage
+     */
+    void scan_blocks(const std::function<void (const cbtl::blocks::access&)>& f){
+        _engine.scan_blocks(f);
+    }
+    cbtl::bloom_filter* index_filter() { return _filter.get(); }
+    cbtl::block_cache& cache() { return _cache; }
+    engine_type& engine() { return _engine; }
+    cbtl::compressor& compression() { return _engine.compression(); }
+
+    /**
+     * @brief binds the engine's asynchronous client (if it has one) to the io_context, detach() before the io_context is destroyed
+     */
+    void attach(boost::asio::io_context& io){
+        if constexpr (asynchronous){
+            _engine.attach(io);
+        }
+    }
+    void detach(){
+        if constexpr (asynchronous){
+            _engine.detach();
+        }
+    }
+
+    /**
+     * @brief completion signature void(boost::system::error_code, bool)
+     */
+    template <typename CompletionToken>
+    auto async_exists(const std::string& id, bool index, CompletionToken&& token){
+        return boost::asio::async_initiate<CompletionToken, void(boost::system::error_code, bool)>([this, id, index](auto handler){
+            auto executor = boost::asio::get_associated_executor(handler);
+            if((!index && _cache.contains(id)) || (index && _filter && !_filter->possibly(id))){
+                complete(executor, std::move(handler), boost::system::error_code(), !index);
+                return;
+            }
+            if constexpr (asynchronous){
+                if(auto* async = _engine.async(id, index)){
+                    async->async_exists(id, index, boost::asio::bind_executor(executor, std::move(handler)));
+                    return;
+                }
+            }
+            boost::system::error_code ec;
+            bool found = false;
+            try{
+                found = _engine.exists(id, index);
+            }catch(const std::exception&){
+                ec = boost::asio::error::fault;
+            }
+            complete(executor, std::move(handler), ec, found);
+        }, token);
+    }
+    /**
+     * @brief completion signature void(boost::system::error_code, std::optional<cbtl::blocks::access>), not_found if there is no such block
+     */
+    template <typename CompletionToken>
+    auto async_fetch(const std::string& block_id, CompletionToken&& token){
+        return boost::asio::async_initiate<CompletionToken, void(boost::system::error_code, std::optional<cbtl::blocks::access>)>([this, block_id](auto handler){
+            auto executor = boost::asio::get_associated_executor(handler);
+            if(std::optional<cbtl::blocks::access> cached = _cache.get(block_id)){
+                complete(executor, std::move(handler), boost::system::error_code(), std::move(cached));
+                return;
+            }
+            if constexpr (asynchronous){
+                if(auto* async = _engine.async(block_id, false)){
+                    async->async_fetch(block_id, boost::asio::bind_executor(executor, [this, block_id, handler = std::move(handler)](boost::system::error_code ec, std::optional<cbtl::blocks::access> block) mutable {
+                        if(!ec && block){
+                            _cache.put(block_id, *block);
+                        }
+                        handler(ec, std::move(block));
+                    }));
+                    return;
+                }
+            }
+            boost::system::error_code ec;
+            std::optional<cbtl::blocks::access> block;
+            try{
+                block = _engine.fetch(block_id);
+                _cache.put(block_id, *block);
+            }catch(const std::out_of_range&){
+                ec = boost::asio::error::not_found;
+            }catch(const std::exception&){
+                ec = boost::asio::error::fault;
+            }
+            complete(executor, std::move(handler), ec, std::move(block));
+        }, token);
+    }
+
+  private:
+    static constexpr bool asynchronous = requires(engine_type& e, boost::asio::io_context& io){ e.attach(io); e.detach(); e.async(std::string(), false); };
+
+    template <typename ExecutorT, typename HandlerT, typename ResultT>
+    static void complete(const ExecutorT& executor, HandlerT&& handler, boost::system::error_code ec, ResultT&& result){
+        boost::asio::post(executor, [handler = std::move(handler), ec, result = std::forward<ResultT>(result)]() mutable {
+            handler(ec, std::move(result));
+        });
+    }
+    /**
+     * @brief adds the addresses to the filter before they are written, so that no reader sees an address in the engine but not in the filter
+     */
+    void remember(const cbtl::blocks::access& block){
+        if(_filter){
+            _filter->insert(cbtl::utils::hex::encode(block.address().active(),  CryptoPP::Integer::UNSIGNED));
+            _filter->insert(cbtl::utils::hex::encode(block.address().passive(), CryptoPP::Integer::UNSIGNED));
+        }
     }
 
-    private:
-        engine_type _engine;
+  private:
+    engine_type                         _engine;
+    cbtl::block_cache                   _cache;
+    std::unique_ptr<cbtl::bloom_filter> _filter;
 };
 
 
@@ -0,0 +1,51 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef cbtl_TICKETS_H
+#define cbtl_TICKETS_H
+
+#include <array>
+#include <string>
+#include <cstdint>
+#include <chrono>
+#include <cryptopp/integer.h>
+#include <cryptopp/sha.h>
+#include "cbtl/keys/private.h"
+
+namespace cbtl{
+
+/**
+ * @brief resumption ticket, the verified position of an active user on its chain sealed by the Trusted Server
+ * A returning client presents the ticket along with its response and skips the request -> challenge round trip.
+ * The ticket is bound to the tip of the active chain, once it has been used the chain moves on and the ticket is stale.
+ */
+struct ticket{
+    using key_type   = std::array<CryptoPP::byte, CryptoPP::SHA256::DIGESTSIZE>;
+    using clock_type = std::chrono::system_clock;
+
+    CryptoPP::Integer last;     ///< id of the tip of the active chain
+    CryptoPP::Integer y;        ///< g^{\pi_{u}}
+    CryptoPP::Integer token;    ///< g^{\pi_{u} r_{u}} of the tip
+    CryptoPP::Integer forward;  ///< forward of the tip
+    CryptoPP::Integer lambda;
+    CryptoPP::Integer shared;   ///< y^{x}, the mask of lambda on the wire
+    std::int64_t      expiry;   ///< seconds since epoch
+
+    /**
+     * @brief the sealing key is derived from the master secret so that every server process can open any ticket
+     */
+    static key_type key(const cbtl::keys::identity::private_key& master);
+    /**
+     * @brief AES-GCM encrypts and authenticates the ticket, the result is base64 encoded
+     */
+    std::string seal(const key_type& key) const;
+    /**
+     * @brief opens a sealed ticket, throws std::invalid_argument if the ticket was tampered with or has expired
+     */
+    static ticket open(const std::string& sealed, const key_type& key);
+    bool expired() const;
+};
+
+}
+
+#endif // cbtl_TICKETS_H
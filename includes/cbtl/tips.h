@@ -0,0 +1,42 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef cbtl_TIPS_H
+#define cbtl_TIPS_H
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <optional>
+#include <unordered_map>
+#include <cryptopp/integer.h>
+#include "cbtl/blocks/access.h"
+
+namespace cbtl{
+
+/**
+ * @brief last known blocks of the passive chains keyed by (patient y, H(gaccess)), bounded by LRU eviction
+ * A chain only ever grows, so a cached tip is never wrong, at worst it is behind and the walk resumes from it.
+ */
+class tip_cache{
+    using list_type = std::list<std::pair<std::string, cbtl::blocks::access>>;
+    std::size_t                                           _capacity;
+    list_type                                             _order;   ///< most recently used first
+    std::unordered_map<std::string, list_type::iterator>  _index;
+    std::mutex                                            _mutex;
+  public:
+    /**
+     * @brief capacity is the number of chains kept, 0 disables the cache
+     */
+    explicit tip_cache(std::size_t capacity): _capacity(capacity) {}
+    static std::string key(const CryptoPP::Integer& y, const CryptoPP::Integer& gaccess);
+    std::optional<cbtl::blocks::access> get(const std::string& key);
+    /**
+     * @brief records block as the tip of the chain
+     */
+    void advance(const std::string& key, const cbtl::blocks::access& block);
+};
+
+}
+
+#endif // cbtl_TIPS_H
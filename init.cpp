@@ -1,6 +1,7 @@
 #include <iostream>
 #include <string>
 #include <array>
+#include <algorithm>
 #include <cassert>
 #include <exception>
 #include <fstream>
@@ -17,7 +18,7 @@
 #include <db_cxx.h>
 #include "cbtl/keys.h"
 #include "cbtl/utils.h"
-#include "cbtl/redis-storage.h"
+#include "cbtl/ledger.h"
 #include "cbtl/blocks.h"
 #include "cbtl/blocks/io.h"
 #include <pqxx/pqxx>
@@ -29,6 +30,7 @@ constexpr static const std::uint32_t key_size = 1024;
 
 int main(int argc, char** argv) {
     unsigned int managers = 0, supers = 0, patients = 0;
+    cbtl::config config;
     boost::program_options::options_description desc("cbtl-gen generates keys for the Trusted Server and Data Managers, Supervisors and patients");
     desc.add_options()
         ("help,h", "prints this help message")
@@ -40,6 +42,7 @@ int main(int argc, char** argv) {
         ("supers,S",     boost::program_options::value<unsigned int>(&supers)->default_value(2),   "number of Supervisors")
         ("patients,P",   boost::program_options::value<unsigned int>(&patients)->default_value(2), "number of Patients")
         ;
+    desc.add(config.storage_options());
 
     boost::program_options::variables_map map;
     boost::program_options::store(boost::program_options::parse_command_line(argc, argv, desc), map);
@@ -79,7 +82,9 @@ int main(int argc, char** argv) {
     cbtl::keys::view_key view(phi);
     view.save("master");
 
-    cbtl::storage db;
+    cbtl::ledger db(config);
+    // the genesis blocks are written in one pipeline once all of them are constructed
+    std::vector<cbtl::blocks::access> genesis_blocks;
     for(std::uint32_t i = 0; i < managers; ++i){
         std::string name = manager+"-"+boost::lexical_cast<std::string>(i);
         cbtl::keys::identity::pair key(rng, trusted_server.pri());
@@ -89,7 +94,7 @@ int main(int argc, char** argv) {
         auto now = boost::posix_time::microsec_clock::local_time();
         cbtl::blocks::params params = cbtl::blocks::params::genesis(trusted_server.pri(), key.pub(), now);
         cbtl::blocks::access genesis = cbtl::blocks::access::genesis(rng, params, trusted_server.pri(), h);
-        db.add(genesis);
+        genesis_blocks.push_back(genesis);
     }
 
     for(std::uint32_t i = 0; i < supers; ++i){
@@ -103,7 +108,7 @@ int main(int argc, char** argv) {
         auto now = boost::posix_time::microsec_clock::local_time();
         cbtl::blocks::params params = cbtl::blocks::params::genesis(trusted_server.pri(), key.pub(), now);
         cbtl::blocks::access genesis = cbtl::blocks::access::genesis(rng, params, trusted_server.pri(), h);
-        db.add(genesis);
+        genesis_blocks.push_back(genesis);
     }
 
     pqxx::connection conn{"postgresql://cbtl_user@localhost/cbtl"};
@@ -133,7 +138,7 @@ int main(int argc, char** argv) {
         auto now = boost::posix_time::microsec_clock::local_time();
         cbtl::blocks::params params = cbtl::blocks::params::genesis(trusted_server.pri(), key.pub(), now);
         cbtl::blocks::access genesis = cbtl::blocks::access::genesis(rng, params, trusted_server.pri(), h);
-        db.add(genesis);
+        genesis_blocks.push_back(genesis);
 
         CryptoPP::Integer pv = trusted_server.pub().random(rng, false), tv0 = trusted_server.pub().random(rng, false);
         std::string y_hex = cbtl::utils::hex::encode(key.pub().y(), CryptoPP::Integer::UNSIGNED);
@@ -154,6 +159,9 @@ int main(int argc, char** argv) {
     }
 
     transaction.commit();
+    std::vector<bool> ok = db.add_batch(genesis_blocks);
+    std::size_t written = std::count(ok.begin(), ok.end(), true);
+    std::cout << written << " of " << genesis_blocks.size() << " genesis blocks written" << std::endl;
 
     // TODO Distribute those keys
 
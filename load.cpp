@@ -0,0 +1,81 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <exception>
+#include <boost/program_options.hpp>
+#include "cbtl/ledger.h"
+#include "cbtl/blocks.h"
+#include "cbtl/snapshot.h"
+
+int main(int argc, char** argv) {
+    cbtl::config config;
+    std::string input;
+    std::size_t threads, batch;
+    boost::program_options::options_description desc("Loads the blocks of a snapshot file into the ledger");
+    desc.add_options()
+        ("help,h",    "prints this help message")
+        ("input,i",   boost::program_options::value<std::string>(&input)->required(), "snapshot file to read")
+        ("threads,j", boost::program_options::value<std::size_t>(&threads)->default_value(std::max(1u, std::thread::hardware_concurrency())), "threads decoding and writing the blocks")
+        ("batch,b",   boost::program_options::value<std::size_t>(&batch)->default_value(1000), "blocks written in one pipeline")
+        ;
+    desc.add(config.storage_options());
+
+    boost::program_options::variables_map map;
+    boost::program_options::store(boost::program_options::parse_command_line(argc, argv, desc), map);
+    if(map.count("help")){
+        std::cout << desc << std::endl;
+        return 1;
+    }
+    boost::program_options::notify(map);
+    threads = std::max<std::size_t>(threads, 1);
+    batch   = std::max<std::size_t>(batch, 1);
+    config.connections = threads;
+    config.cache_blocks = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    cbtl::snapshot::reader snapshot(input);
+    std::vector<cbtl::snapshot::reader::record> records = snapshot.records();
+    cbtl::ledger db(config);
+
+    // every thread claims the next batch of records, decodes it and writes it in one pipeline
+    std::atomic<std::size_t> next(0), written(0);
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    std::vector<std::thread> workers;
+    for(std::size_t t = 0; t < threads; ++t){
+        workers.emplace_back([&](){
+            try{
+                std::vector<cbtl::blocks::access> blocks;
+                for(std::size_t begin = next.fetch_add(batch); begin < records.size(); begin = next.fetch_add(batch)){
+                    std::size_t end = std::min(begin + batch, records.size());
+                    blocks.clear();
+                    for(std::size_t i = begin; i < end; ++i){
+                        blocks.push_back(records[i].block());
+                    }
+                    std::vector<bool> ok = db.add_batch(blocks);
+                    written += std::count(ok.begin(), ok.end(), true);
+                }
+            }catch(...){
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if(!error) error = std::current_exception();
+                // the other threads stop after their current batch
+                next = records.size();
+            }
+        });
+    }
+    for(std::thread& worker: workers){
+        worker.join();
+    }
+    if(error){
+        std::rethrow_exception(error);
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    std::cout << written << " of " << records.size() << " blocks loaded from " << input << " in " << elapsed << "ms (" << records.size() - written << " already existed)" << std::endl;
+
+    return 0;
+}
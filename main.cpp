@@ -1,22 +1,47 @@
 #include <boost/asio.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/program_options.hpp>
-#include "cbtl/redis-storage.h"
+#include "cbtl/ledger.h"
 #include "cbtl/server.h"
 #include "cbtl/keys.h"
+#include "cbtl/config.h"
 
 int main(int argc, char** argv){
+    cbtl::config config;
     boost::program_options::options_description desc("CLI Frontend for Data Managers");
     desc.add_options()
         ("help,h", "prints this help message")
         ("public,p", boost::program_options::value<std::string>(), "path to the public key")
         ("secret,s", boost::program_options::value<std::string>(), "path to the secret key")
         ("view,v",   boost::program_options::value<std::string>(), "path to the master view secret")
+        ("workers,w", boost::program_options::value<std::size_t>(&config.workers)->default_value(config.workers), "number of server processes sharing the port")
+        ("threads,t", boost::program_options::value<std::size_t>(&config.threads)->default_value(config.threads), "number of threads serving the sessions")
+        ("compute,c", boost::program_options::value<std::size_t>(&config.compute)->default_value(config.compute), "number of threads computing the cryptographic operations")
+        ("connections", boost::program_options::value<std::size_t>(&config.connections), "redis connections per worker and instance (default threads + compute)")
+        ("cache", boost::program_options::value<std::size_t>(&config.cache_blocks)->default_value(config.cache_blocks), "decoded blocks cached per worker, 0 disables the cache")
+        ("tip-cache", boost::program_options::value<std::size_t>(&config.tip_cache)->default_value(config.tip_cache), "passive chain tips cached per worker, 0 disables the cache")
+        ("write-batch", boost::program_options::value<std::size_t>(&config.write_batch)->default_value(config.write_batch), "blocks of concurrent sessions written in one pipeline, at most the compute threads, 1 writes every block on its own")
+        ("write-delay", boost::program_options::value<std::uint32_t>(&config.write_delay)->default_value(config.write_delay), "microseconds a block waits for its write batch to fill")
+        ("index-filter", boost::program_options::value<std::size_t>(&config.index_filter)->default_value(config.index_filter), "addresses the address index filter is sized for, 0 disables it; only safe while this server is the ledger's sole writer")
+        ("max-frame", boost::program_options::value<std::uint32_t>(&config.max_frame)->default_value(config.max_frame), "largest accepted frame in bytes")
+        ("max-sessions", boost::program_options::value<std::size_t>(&config.max_sessions)->default_value(config.max_sessions), "open sessions beyond which connections are refused, 0 for no limit")
+        ("max-jobs", boost::program_options::value<std::size_t>(&config.max_jobs), "crypto jobs queued beyond which frames are refused, 0 for no limit (default 64 per compute thread)")
+        ("max-inflight", boost::program_options::value<std::size_t>(&config.max_inflight)->default_value(config.max_inflight), "frames of one connection handled at once")
+        ("handshake-timeout", boost::program_options::value<std::uint32_t>(&config.handshake_timeout)->default_value(config.handshake_timeout), "seconds to send the first frame or to answer a challenge, 0 for no limit")
+        ("idle-timeout", boost::program_options::value<std::uint32_t>(&config.idle_timeout)->default_value(config.idle_timeout), "seconds an idle connection is kept open, 0 for no limit")
+        ("ticket-lifetime", boost::program_options::value<std::uint32_t>(&config.ticket_lifetime)->default_value(config.ticket_lifetime), "seconds a resumption ticket stays valid, 0 disables resumption")
         ;
+    desc.add(config.storage_options());
 
     boost::program_options::variables_map map;
     boost::program_options::store(boost::program_options::parse_command_line(argc, argv, desc), map);
     boost::program_options::notify(map);
+    if(!map.count("max-jobs")){
+        config.max_jobs = 64 * config.compute;
+    }
+    if(!map.count("connections")){
+        config.connections = config.threads + config.compute;
+    }
 
     if(map.count("help") || !map.count("public") || !map.count("secret")){
         std::cout << desc << std::endl;
@@ -27,18 +52,31 @@ int main(int argc, char** argv){
                 secret_key = map["secret"].as<std::string>(),
                 view_key   = map["view"].as<std::string>();
 
-    cbtl::storage db;
-
     cbtl::keys::identity::pair master(secret_key, public_key);
     cbtl::keys::view_key view(view_key);
     // master.init();
 
-    boost::asio::io_service io;
+    // every worker opens its own storage connection and io_context after the fork, they share nothing but the stores
+    std::vector<pid_t> children = cbtl::server::fork(config.workers);
+    {
+        cbtl::ledger db(config);
+        if(config.index_filter > 0 && config.workers == 1){
+            // another worker's writes would be invisible to this process's filter
+            db.track(config.index_filter);
+            std::cout << "index filter: " << db.index_filter()->count() << " addresses loaded" << std::endl;
+        }
+        boost::asio::io_service io;
 
-    cbtl::server server(db, master, view, io, 9887);
-    server.run();
+        cbtl::server server(db, master, view, config, io, 9887);
+        server.run();
 
-    io.run();
+        cbtl::block_cache::statistics stats = db.cache().stats();
+        std::cout << "cache: " << stats.hits << " hits " << stats.misses << " misses " << stats.evictions << " evictions " << stats.size << " blocks" << std::endl;
+        cbtl::compressor::statistics compression = db.compression().stats();
+        std::cout << "compression: " << compression.packed << " blocks " << compression.raw << " -> " << compression.stored << " bytes (ratio " << compression.ratio() << ") in " << compression.pack_time << "us, "
+                  << compression.unpacked << " blocks decompressed in " << compression.unpack_time << "us" << std::endl;
+    }
+    cbtl::server::reap(children);
 
     return 0;
 }
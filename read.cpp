@@ -6,7 +6,7 @@
 #include <boost/program_options.hpp>
 #include <nlohmann/json.hpp>
 #include <boost/asio.hpp>
-#include "cbtl/redis-storage.h"
+#include "cbtl/ledger.h"
 #include "cbtl/packets.h"
 #include "cbtl/keys.h"
 #include "cbtl/blocks.h"
@@ -17,6 +17,7 @@
 #include <cryptopp/hex.h>
 
 int main(int argc, char** argv) {
+    cbtl::config config;
     boost::program_options::options_description desc("CLI Block Reader for Data Managers and Supervisors");
     desc.add_options()
         ("help,h",    "prints this help message")
@@ -31,6 +32,7 @@ int main(int argc, char** argv) {
         ("passive,v", boost::program_options::bool_switch()->default_value(false), "traverse passive")
         ("super,x",   boost::program_options::bool_switch()->default_value(false), "view as supervisor")
         ;
+    desc.add(config.storage_options());
 
     boost::program_options::variables_map map;
     boost::program_options::store(boost::program_options::parse_command_line(argc, argv, desc), map);
@@ -60,7 +62,7 @@ int main(int argc, char** argv) {
 
         std::uint64_t limit = map["limit"].as<std::uint64_t>();
 
-        cbtl::storage db;
+        cbtl::ledger db(config);
 
         cbtl::keys::identity::pair user(secret_key, public_key);
         cbtl::keys::identity::public_key master(master_key);
@@ -100,9 +102,15 @@ int main(int argc, char** argv) {
                                 ? last.active().prev (user.pub().G(), last.address().active(),  last.passive().forward(), user.pri())
                                 : last.passive().prev(user.pub().G(), last.address().passive(), last.active().forward(),  user.pri());
             }
-            if(db.exists(address, forward)){
-                std::string block_id = forward ? db.id(address) : address;
-                cbtl::blocks::access current = db.fetch(block_id);
+            std::optional<cbtl::blocks::access> next;
+            if(forward){
+                next = db.resolve(address);
+            }else if(db.exists(address)){
+                next = db.fetch(address);
+            }
+            if(next){
+                std::string block_id = next->address().hash();
+                cbtl::blocks::access current = std::move(*next);
                 CryptoPP::Integer x;
                 if(is_active){
                     if(forward){
@@ -164,7 +172,7 @@ int main(int argc, char** argv) {
         auto G = secret.G();
         auto Gp = G.Gp(), Gp1 = G.Gp1();
 
-        cbtl::storage db;
+        cbtl::ledger db(config);
         std::string plaintext;
         try{
             cbtl::blocks::access block = db.fetch(id);
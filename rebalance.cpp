@@ -0,0 +1,119 @@
+#include <map>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <stdexcept>
+#include <boost/program_options.hpp>
+#include <hiredis/hiredis.h>
+#include "cbtl/redis-ring.h"
+
+namespace{
+    redisContext* connect(const cbtl::redis_ring::endpoint& endpoint){
+        redisContext* context = redisConnect(endpoint.host.c_str(), endpoint.port);
+        if(!context || context->err){
+            std::string reason = context ? context->errstr : "allocation failed";
+            if(context) redisFree(context);
+            throw std::runtime_error("redis: failed to connect to " + endpoint.str() + ": " + reason);
+        }
+        return context;
+    }
+
+    /**
+     * @brief moves the keys to the destination with one MIGRATE, the keys are immutable so REPLACE only makes a rerun idempotent
+     */
+    void migrate(redisContext* context, const cbtl::redis_ring::endpoint& destination, const std::vector<std::string>& keys){
+        std::vector<std::string> args = {"MIGRATE", destination.host, std::to_string(destination.port), "", "0", "5000", "REPLACE", "KEYS"};
+        args.insert(args.end(), keys.begin(), keys.end());
+        std::vector<const char*> argv;
+        std::vector<std::size_t> argvlen;
+        for(const std::string& arg: args){
+            argv.push_back(arg.data());
+            argvlen.push_back(arg.size());
+        }
+        redisReply* reply = (redisReply*) redisCommandArgv(context, argv.size(), argv.data(), argvlen.data());
+        if(!reply || reply->type == REDIS_REPLY_ERROR){
+            std::string reason = reply ? std::string(reply->str, reply->len) : std::string(context->errstr);
+            if(reply) freeReplyObject(reply);
+            throw std::runtime_error("redis: MIGRATE to " + destination.str() + " failed " + reason);
+        }
+        freeReplyObject(reply);
+    }
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> from, to;
+    std::size_t batch;
+    boost::program_options::options_description desc("Moves the ledger keys between redis shards after shards were added or removed");
+    desc.add_options()
+        ("help,h",    "prints this help message")
+        ("from,f",    boost::program_options::value<std::vector<std::string>>(&from)->multitoken()->required(), "redis instances (host:port) the keys are sharded over now")
+        ("to,t",      boost::program_options::value<std::vector<std::string>>(&to)->multitoken()->required(),   "redis instances (host:port) the keys are to be sharded over")
+        ("batch,b",   boost::program_options::value<std::size_t>(&batch)->default_value(1000), "keys moved by one MIGRATE")
+        ("dry-run,n", boost::program_options::bool_switch()->default_value(false), "only count the keys that would move")
+        ;
+
+    boost::program_options::variables_map map;
+    boost::program_options::store(boost::program_options::parse_command_line(argc, argv, desc), map);
+    if(map.count("help")){
+        std::cout << desc << std::endl;
+        return 1;
+    }
+    boost::program_options::notify(map);
+    bool dry = map["dry-run"].as<bool>();
+    batch = std::max<std::size_t>(batch, 1);
+
+    cbtl::redis_ring source(from), target(to);
+    std::size_t total = 0;
+    for(std::size_t shard = 0; shard < source.size(); ++shard){
+        const cbtl::redis_ring::endpoint& endpoint = source.at(shard);
+        std::size_t scanned = 0, moved = 0;
+        redisContext* context = connect(endpoint);
+        // keys leaving this shard grouped by the shard they move to, flushed every batch keys
+        std::map<std::size_t, std::vector<std::string>> leaving;
+        auto flush = [&](std::size_t destination){
+            std::vector<std::string>& keys = leaving[destination];
+            if(!keys.empty()){
+                if(!dry){
+                    migrate(context, target.at(destination), keys);
+                }
+                moved += keys.size();
+                keys.clear();
+            }
+        };
+        std::string cursor = "0";
+        do{
+            redisReply* reply = (redisReply*) redisCommand(context, "SCAN %s COUNT 1000", cursor.c_str());
+            if(!reply || reply->type != REDIS_REPLY_ARRAY || reply->elements != 2){
+                if(reply) freeReplyObject(reply);
+                throw std::runtime_error("redis: SCAN of " + endpoint.str() + " failed " + context->errstr);
+            }
+            cursor = std::string(reply->element[0]->str, reply->element[0]->len);
+            redisReply* keys = reply->element[1];
+            for(std::size_t i = 0; i < keys->elements; ++i){
+                std::string key(keys->element[i]->str, keys->element[i]->len);
+                if(!key.starts_with("id:") && !key.starts_with("addr:")){
+                    continue;
+                }
+                ++scanned;
+                std::size_t destination = target.locate(cbtl::redis_ring::route(key));
+                if(target.at(destination).str() != endpoint.str()){
+                    leaving[destination].push_back(key);
+                    if(leaving[destination].size() >= batch){
+                        flush(destination);
+                    }
+                }
+            }
+            freeReplyObject(reply);
+        }while(cursor != "0");
+        for(auto& entry: leaving){
+            flush(entry.first);
+        }
+        redisFree(context);
+        std::cout << endpoint.str() << ": " << scanned << " keys scanned " << moved << (dry ? " to be moved" : " moved") << std::endl;
+        total += moved;
+    }
+    std::cout << total << " keys" << (dry ? " to be moved" : " moved") << std::endl;
+
+    return 0;
+}
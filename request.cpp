@@ -1,4 +1,6 @@
 #include <iostream>
+#include <fstream>
+#include <filesystem>
 #include <array>
 #include <boost/array.hpp>
 #include <string>
@@ -6,21 +8,21 @@
 #include <boost/program_options.hpp>
 #include <nlohmann/json.hpp>
 #include <boost/asio.hpp>
-#include "cbtl/redis-storage.h"
+#include "cbtl/ledger.h"
 #include "cbtl/packets.h"
 #include "cbtl/keys.h"
 
-boost::system::error_code receive(boost::asio::ip::tcp::socket& socket, nlohmann::json& json){
+boost::system::error_code receive(boost::asio::ip::tcp::socket& socket, cbtl::packets::header& header, nlohmann::json& json){
     using buffer_type = boost::array<std::uint8_t, sizeof(cbtl::packets::header)>;
     buffer_type buff;
     boost::system::error_code error;
-    std::size_t len = socket.read_some(boost::asio::buffer(buff), error);
+    std::size_t len = boost::asio::read(socket, boost::asio::buffer(buff), error);
     if(!error){
         assert(len == buff.size());
-        cbtl::packets::header header;
         std::copy_n(buff.cbegin(), len, reinterpret_cast<std::uint8_t*>(&header));
         header.size = ntohl(header.size);
-        std::cout << "expecting data " << header.size << std::endl;
+        header.id   = ntohl(header.id);
+        std::cout << "expecting data " << header.size << " for request " << header.id << std::endl;
 
         constexpr std::uint32_t buffer_size = 2048;
         boost::array<char, buffer_size> data;
@@ -44,6 +46,7 @@ boost::system::error_code receive(boost::asio::ip::tcp::socket& socket, nlohmann
 }
 
 int main(int argc, char** argv) {
+    cbtl::config config;
     boost::program_options::options_description desc("CLI Frontend for Data Managers");
     desc.add_options()
         ("help,h",    "prints this help message")
@@ -54,7 +57,10 @@ int main(int argc, char** argv) {
         ("anchor,A",  boost::program_options::value<std::string>(),   "record anchor to identify")
         ("patient,P", boost::program_options::value<std::string>(),    "public key of the patient who's record to access")
         ("insert,I",  "records to insert for patient identified by -P")
+        ("batch,B",   boost::program_options::value<std::string>(),   "path to a JSON array of actions to perform under one challenge")
+        ("ticket,T",  boost::program_options::value<std::string>(),   "path to keep the resumption ticket in, an existing ticket is used in place of a challenge")
         ;
+    desc.add(config.storage_options());
 
     boost::program_options::variables_map map;
     boost::program_options::store(boost::program_options::parse_command_line(argc, argv, desc), map);
@@ -70,7 +76,7 @@ int main(int argc, char** argv) {
                 access_key = map["access"].as<std::string>(),
                 master_key = map["master"].as<std::string>();
 
-    cbtl::storage db;
+    cbtl::ledger db(config);
 
     cbtl::keys::identity::pair user(secret_key, public_key);
     cbtl::keys::identity::public_key master_pub(master_key);
@@ -90,34 +96,83 @@ int main(int argc, char** argv) {
         return 1;
     }
 
-    cbtl::packets::request request = cbtl::packets::request::construct(db, user);
-    nlohmann::json request_json = request;
-    std::cout << ">> " << std::endl << request_json.dump(4) << std::endl;
-    {
-        cbtl::packets::envelop<cbtl::packets::request> envelop(cbtl::packets::type::request, request);
-        envelop.write(socket);
-    }
-    using buffer_type = boost::array<std::uint8_t, sizeof(cbtl::packets::header)>;
+    // one operation per invocation, the id only has to be unique among the operations in flight on the connection
+    const std::uint32_t id = 1;
+    cbtl::packets::header header;
+    boost::system::error_code error;
+    CryptoPP::Integer lambda;
+
+    // a ticket left by the previous invocation skips the request -> challenge round trip
+    std::string ticket_path = map.count("ticket") ? map["ticket"].as<std::string>() : std::string();
+    std::string sealed;
+    if(!ticket_path.empty() && std::filesystem::exists(ticket_path)){
+        std::ifstream ticket_file(ticket_path);
+        nlohmann::json ticket_json = nlohmann::json::parse(ticket_file);
+        sealed = ticket_json["sealed"].get<std::string>();
+        lambda = Gp.Divide(cbtl::utils::hex::decode(ticket_json["random"].get<std::string>(), CryptoPP::Integer::UNSIGNED), Gp.Exponentiate(master_pub.y(), user.pri().x()));
+        std::filesystem::remove(ticket_path);
+    }else{
+        cbtl::packets::request request = cbtl::packets::request::construct(db, user);
+        request.resume = !ticket_path.empty();
+        nlohmann::json request_json = request;
+        std::cout << ">> " << std::endl << request_json.dump(4) << std::endl;
+        {
+            cbtl::packets::envelop<cbtl::packets::request> envelop(cbtl::packets::type::request, request, id);
+            envelop.write(socket);
+        }
 
-    nlohmann::json challenge_json;
-    boost::system::error_code error = receive(socket, challenge_json);
+        nlohmann::json challenge_json;
+        error = receive(socket, header, challenge_json);
+        if(!error){
+            std::cout << "<< " << std::endl << challenge_json.dump(4) << std::endl;
+            if(static_cast<cbtl::packets::type>(header.type) != cbtl::packets::type::challenge){
+                return 1;
+            }
+            cbtl::packets::challenge challenge = challenge_json;
+            lambda = Gp.Divide(challenge.random, Gp.Exponentiate(master_pub.y(), user.pri().x()));
+        }
+    }
     if(!error){
-        std::cout << "<< " << std::endl << challenge_json.dump(4) << std::endl;
-        cbtl::packets::challenge challenge = challenge_json;
-        CryptoPP::Integer lambda = Gp.Divide(challenge.random, Gp.Exponentiate(master_pub.y(), user.pri().x()));
-
-        if(map.count("anchor")){
-            std::string anchor = map["anchor"].as<std::string>();
-            auto action = cbtl::packets::action<cbtl::packets::actions::identify>(anchor);
-            auto response = cbtl::packets::respond(action, user.pri(), access, lambda);
-
-            // send the challenge
-            nlohmann::json response_json = challenge;
+        // answers the challenge, or goes along with the ticket in a resume frame
+        auto reply = [&](const auto& response){
+            nlohmann::json response_json = response;
             std::cout << ">> " << std::endl << response_json.dump(4) << std::endl;
-            {
-                cbtl::packets::envelop<cbtl::packets::response<cbtl::packets::action_data<cbtl::packets::actions::identify>>> envelop(cbtl::packets::type::response, response);
+            if(sealed.empty()){
+                cbtl::packets::envelop<std::decay_t<decltype(response)>> envelop(cbtl::packets::type::response, response, id);
+                envelop.write(socket);
+            }else{
+                cbtl::packets::resumption resumption{sealed, cbtl::packets::resumption::prove(sealed, lambda), response_json};
+                cbtl::packets::envelop<cbtl::packets::resumption> envelop(cbtl::packets::type::resume, resumption, id);
                 envelop.write(socket);
             }
+        };
+
+        if(map.count("batch")){
+            // [{"anchor": "..."}, {"patient": "patient.pub"}, {"patient": "patient.pub", "insert": ["...", "..."]}]
+            std::ifstream batch_file(map["batch"].as<std::string>());
+            nlohmann::json batch_json = nlohmann::json::parse(batch_file);
+            cbtl::packets::action_data<cbtl::packets::actions::batch> action;
+            for(const nlohmann::json& item: batch_json){
+                if(item.contains("anchor")){
+                    action.add(cbtl::packets::action<cbtl::packets::actions::identify>(item["anchor"].get<std::string>()));
+                }else if(item.contains("insert")){
+                    cbtl::keys::identity::public_key patient_pub(item["patient"].get<std::string>());
+                    auto insert = cbtl::packets::action<cbtl::packets::actions::insert>(patient_pub);
+                    for(const nlohmann::json& line: item["insert"]){
+                        insert.add(line.get<std::string>());
+                    }
+                    action.add(insert);
+                }else{
+                    cbtl::keys::identity::public_key patient_pub(item["patient"].get<std::string>());
+                    action.add(cbtl::packets::action<cbtl::packets::actions::fetch>(patient_pub));
+                }
+            }
+            std::cout << action.count() << " actions in batch" << std::endl;
+            reply(cbtl::packets::respond(action, user.pri(), access, lambda));
+        }else if(map.count("anchor")){
+            std::string anchor = map["anchor"].as<std::string>();
+            auto action = cbtl::packets::action<cbtl::packets::actions::identify>(anchor);
+            reply(cbtl::packets::respond(action, user.pri(), access, lambda));
         }else if(map.count("insert")){
             std::string patient_pub_str = map["patient"].as<std::string>();
             cbtl::keys::identity::public_key patient_pub(patient_pub_str);
@@ -132,34 +187,22 @@ int main(int argc, char** argv) {
                 }
             }
             std::cout << action.count() << " cases in action" << std::endl;
-            auto response = cbtl::packets::respond(action, user.pri(), access, lambda);
-
-            // send the challenge
-            nlohmann::json response_json = challenge;
-            std::cout << ">> " << std::endl << response_json.dump(4) << std::endl;
-            {
-                cbtl::packets::envelop<cbtl::packets::response<cbtl::packets::action_data<cbtl::packets::actions::insert>>> envelop(cbtl::packets::type::response, response);
-                envelop.write(socket);
-            }
+            reply(cbtl::packets::respond(action, user.pri(), access, lambda));
         }else if(map.count("patient")){
             std::string patient_pub_str = map["patient"].as<std::string>();
             cbtl::keys::identity::public_key patient_pub(patient_pub_str);
             auto action = cbtl::packets::action<cbtl::packets::actions::fetch>(patient_pub);
-            auto response = cbtl::packets::respond(action, user.pri(), access, lambda);
-
-            // send the challenge
-            nlohmann::json response_json = challenge;
-            std::cout << ">> " << std::endl << response_json.dump(4) << std::endl;
-            {
-                cbtl::packets::envelop<cbtl::packets::response<cbtl::packets::action_data<cbtl::packets::actions::fetch>>> envelop(cbtl::packets::type::response, response);
-                envelop.write(socket);
-            }
+            reply(cbtl::packets::respond(action, user.pri(), access, lambda));
         }
 
         nlohmann::json result_json;
-        error = receive(socket, result_json);
+        error = receive(socket, header, result_json);
         if(!error){
             std::cout << "<< " << std::endl << result_json.dump(4) << std::endl;
+            if(!ticket_path.empty() && result_json["aux"].contains("ticket")){
+                std::ofstream ticket_file(ticket_path);
+                ticket_file << result_json["aux"]["ticket"].dump();
+            }
         }
     }
 
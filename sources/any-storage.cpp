@@ -0,0 +1,59 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "cbtl/any-storage.h"
+#include "cbtl/redis-storage.h"
+#include "cbtl/memory-storage.h"
+#if defined(CBTL_WITH_BDB)
+#include "cbtl/bdb-storage.h"
+#endif
+#if defined(CBTL_WITH_LMDB)
+#include "cbtl/lmdb-storage.h"
+#endif
+#include <stdexcept>
+
+template <typename EngineT>
+struct cbtl::engines::any::model: cbtl::engines::any::base{
+    EngineT _engine;
+
+    explicit model(const cbtl::config& config): _engine(config) {}
+    bool add(const cbtl::blocks::access& block) override { return _engine.add(block); }
+    std::vector<bool> add_batch(const std::vector<cbtl::blocks::access>& blocks) override { return _engine.add_batch(blocks); }
+    bool exists(const std::string& id, bool index) override { return _engine.exists(id, index); }
+    std::string id(const std::string& addr) override { return _engine.id(addr); }
+    cbtl::blocks::access fetch(const std::string& block_id) override { return _engine.fetch(block_id); }
+    std::optional<cbtl::blocks::access> resolve(const std::string& address) override { return _engine.resolve(address); }
+    void scan_addresses(const std::function<void (const std::string&)>& f) override { _engine.scan_addresses(f); }
+    void scan_blocks(const std::function<void (const cbtl::blocks::access&)>& f) override { _engine.scan_blocks(f); }
+    cbtl::compressor& compression() override { return _engine.compression(); }
+    void attach(boost::asio::io_context& io) override {
+        if constexpr (std::is_same_v<EngineT, cbtl::engines::redis>) _engine.attach(io);
+    }
+    void detach() override {
+        if constexpr (std::is_same_v<EngineT, cbtl::engines::redis>) _engine.detach();
+    }
+    cbtl::async_storage* async(const std::string& id, bool index) override {
+        if constexpr (std::is_same_v<EngineT, cbtl::engines::redis>) return _engine.async(id, index);
+        else return 0x0;
+    }
+};
+
+cbtl::engines::any::any(const cbtl::config& config){
+    if(config.engine == "redis"){
+        _engine = std::make_unique<model<cbtl::engines::redis>>(config);
+    }else if(config.engine == "memory"){
+        _engine = std::make_unique<model<cbtl::engines::memory>>(config);
+#if defined(CBTL_WITH_BDB)
+    }else if(config.engine == "bdb"){
+        _engine = std::make_unique<model<cbtl::engines::bdb>>(config);
+#endif
+#if defined(CBTL_WITH_LMDB)
+    }else if(config.engine == "lmdb"){
+        _engine = std::make_unique<model<cbtl::engines::lmdb>>(config);
+#endif
+    }else{
+        throw std::invalid_argument("storage engine " + config.engine + " is not available");
+    }
+}
+
+cbtl::engines::any::~any() { }
@@ -4,23 +4,24 @@
 #include "cbtl/bdb-storage.h"
 #include "cbtl/blocks.h"
 #include "cbtl/blocks/io.h"
+#include "cbtl/blocks/codec.h"
 #include <exception>
 #include <filesystem>
 
-cbtl::storage::storage(): _env(std::uint32_t(0)), _opened(false) {
-    std::filesystem::path env_dir("storage");
+cbtl::engines::bdb::bdb(const cbtl::config& config): _compressor(config), _blocks(0x0), _index(0x0), _env(std::uint32_t(0)), _opened(false) {
+    std::filesystem::path env_dir(config.path);
     if(!std::filesystem::exists(env_dir) || !std::filesystem::is_directory(env_dir)){
         std::filesystem::create_directory(env_dir);
     }
-    _env.open("storage", DB_CREATE | DB_INIT_LOCK | DB_INIT_MPOOL | DB_INIT_TXN, 0);
+    _env.open(config.path.c_str(), DB_CREATE | DB_INIT_LOCK | DB_INIT_MPOOL | DB_INIT_TXN, 0);
 }
 
-cbtl::storage::~storage(){
+cbtl::engines::bdb::~bdb(){
     close();
 }
 
 
-void cbtl::storage::open(){
+void cbtl::engines::bdb::open(){
     _blocks = new Db(&_env, 0);
     _index  = new Db(&_env, 0);
     // _env.txn_begin(NULL, &_transaction, 0);
@@ -29,7 +30,7 @@ void cbtl::storage::open(){
     // _opened = true;
 }
 
-void cbtl::storage::close(){
+void cbtl::engines::bdb::close(){
     if(_opened){
         _blocks->sync(0);
         _blocks->close(0);
@@ -48,73 +49,124 @@ void cbtl::storage::close(){
 }
 
 
-bool cbtl::storage::add(const cbtl::blocks::access& block){
+bool cbtl::engines::bdb::add(const cbtl::blocks::access& block){
     std::string block_id = block.address().hash();
-    // if(exists(block_id)){
-    //     return false;
-    // }
-    open();
-    nlohmann::json json = block;
-    std::string block_str = json.dump();
+    std::string block_str = cbtl::blocks::codec::serialize(block, _compressor);
+    std::lock_guard<std::mutex> lock(_mutex);
+    scope handles(*this);
 
-    int r_block = 0, r_addr_active = 0, r_addr_passive = 0;
-
-    Dbt id((void*) block_id.c_str(), block_id.size());
-    {
+    // all or nothing like MSETNX, a conflict on any key aborts the puts made before it
+    DbTxn* txn = 0x0;
+    _env.txn_begin(NULL, &txn, 0);
+    try{
+        Dbt id((void*) block_id.c_str(), block_id.size());
         Dbt value((void*) block_str.c_str(), block_str.size());
-        r_block = _blocks->put(NULL, &id, &value, DB_NOOVERWRITE);
-    }
-    if(!block.genesis()){
-        {
-            std::string active_address = cbtl::utils::hex::encode(block.address().active(), CryptoPP::Integer::UNSIGNED);
-            Dbt key((void*) active_address.c_str(), active_address.size());
-            r_addr_active = _index->put(NULL, &key, &id, DB_NOOVERWRITE);
-            // std::cout << "r_addr_active: " << r_addr_active << std::endl;
-        }{
+        bool ok = _blocks->put(txn, &id, &value, DB_NOOVERWRITE) == 0;
+        if(ok && !block.genesis()){
+            std::string active_address  = cbtl::utils::hex::encode(block.address().active(),  CryptoPP::Integer::UNSIGNED);
             std::string passive_address = cbtl::utils::hex::encode(block.address().passive(), CryptoPP::Integer::UNSIGNED);
-            Dbt key((void*) passive_address.c_str(), passive_address.size());
-            r_addr_passive = _index->put(NULL, &key, &id, DB_NOOVERWRITE);
-            // std::cout << "r_addr_passive: " << r_addr_passive << std::endl;
+            Dbt active((void*) active_address.c_str(), active_address.size());
+            Dbt passive((void*) passive_address.c_str(), passive_address.size());
+            ok = _index->put(txn, &active,  &id, DB_NOOVERWRITE) == 0
+              && _index->put(txn, &passive, &id, DB_NOOVERWRITE) == 0;
+        }
+        if(ok){
+            txn->commit(0);
+        }else{
+            txn->abort();
         }
+        return ok;
+    }catch(...){
+        txn->abort();
+        throw;
     }
-    close();
-    return r_block == 0 && r_addr_active == 0 && r_addr_passive == 0;
 }
 
-bool cbtl::storage::exists(const std::string& id, bool index){
-    open();
+std::vector<bool> cbtl::engines::bdb::add_batch(const std::vector<cbtl::blocks::access>& blocks){
+    std::vector<bool> ok(blocks.size(), false);
+    for(std::size_t i = 0; i < blocks.size(); ++i){
+        ok[i] = add(blocks[i]);
+    }
+    return ok;
+}
+
+bool cbtl::engines::bdb::exists(const std::string& id, bool index){
+    std::lock_guard<std::mutex> lock(_mutex);
+    scope handles(*this);
     Db* db = index ? _index : _blocks;
     Dbt key((void*) id.c_str(), id.size());
-    int ret = db->exists(NULL, &key, 0);
-    close();
-    return ret != DB_NOTFOUND;
+    return db->exists(NULL, &key, 0) != DB_NOTFOUND;
 }
 
-std::string cbtl::storage::id(const std::string& addr){
-    open();
+std::string cbtl::engines::bdb::id(const std::string& addr){
+    std::lock_guard<std::mutex> lock(_mutex);
+    scope handles(*this);
     Dbt id((void*) addr.c_str(), addr.size()), value;
     int ret = _index->get(NULL, &id, &value, 0);
     if(ret == DB_NOTFOUND){
         throw std::out_of_range("address "+ addr + " not found");
-    }else{
-        std::string id((const char*) value.get_data(), value.get_size());
-        close();
-        return id;
     }
+    return std::string((const char*) value.get_data(), value.get_size());
 }
 
 
-cbtl::blocks::access cbtl::storage::fetch(const std::string& block_id){
-    open();
+cbtl::blocks::access cbtl::engines::bdb::fetch(const std::string& block_id){
+    std::lock_guard<std::mutex> lock(_mutex);
+    scope handles(*this);
     Dbt id((void*) block_id.c_str(), block_id.size()), value;
     int ret = _blocks->get(NULL, &id, &value, 0);
     if(ret == DB_NOTFOUND){
         throw std::out_of_range("block "+ block_id + " not found");
-    }else{
-        std::string json_str((const char*) value.get_data(), value.get_size());
-        nlohmann::json json = nlohmann::json::parse(json_str);
-        cbtl::blocks::access block = json;
-        close();
-        return block;
     }
+    return cbtl::blocks::codec::deserialize(std::string_view((const char*) value.get_data(), value.get_size()), _compressor);
+}
+
+void cbtl::engines::bdb::scan_addresses(const std::function<void (const std::string&)>& f){
+    std::lock_guard<std::mutex> lock(_mutex);
+    scope handles(*this);
+    Dbc* cursor;
+    _index->cursor(NULL, &cursor, 0);
+    Dbt key, value;
+    try{
+        while(cursor->get(&key, &value, DB_NEXT) == 0){
+            f(std::string((const char*) key.get_data(), key.get_size()));
+        }
+    }catch(...){
+        // the cursor has to be closed before its database
+        cursor->close();
+        throw;
+    }
+    cursor->close();
+}
+
+void cbtl::engines::bdb::scan_blocks(const std::function<void (const cbtl::blocks::access&)>& f){
+    std::lock_guard<std::mutex> lock(_mutex);
+    scope handles(*this);
+    Dbc* cursor;
+    _blocks->cursor(NULL, &cursor, 0);
+    Dbt key, value;
+    try{
+        while(cursor->get(&key, &value, DB_NEXT) == 0){
+            f(cbtl::blocks::codec::deserialize(std::string_view((const char*) value.get_data(), value.get_size()), _compressor));
+        }
+    }catch(...){
+        // the cursor has to be closed before its database
+        cursor->close();
+        throw;
+    }
+    cursor->close();
+}
+
+std::optional<cbtl::blocks::access> cbtl::engines::bdb::resolve(const std::string& address){
+    std::lock_guard<std::mutex> lock(_mutex);
+    scope handles(*this);
+    std::optional<cbtl::blocks::access> block;
+    Dbt addr((void*) address.c_str(), address.size()), id;
+    if(_index->get(NULL, &addr, &id, 0) != DB_NOTFOUND){
+        Dbt value;
+        if(_blocks->get(NULL, &id, &value, 0) != DB_NOTFOUND){
+            block = cbtl::blocks::codec::deserialize(std::string_view((const char*) value.get_data(), value.get_size()), _compressor);
+        }
+    }
+    return block;
 }
@@ -5,7 +5,6 @@
 #include "cbtl/blocks/contents.h"
 #include "cbtl/utils.h"
 #include "cbtl/keys.h"
-#include "cbtl/redis-storage.h"
 #include <cryptopp/nbtheory.h>
 #include <cryptopp/polynomi.h>
 #include <cryptopp/aes.h>
@@ -44,6 +43,11 @@ cbtl::blocks::access cbtl::blocks::access::genesis(CryptoPP::AutoSeededRandomPoo
 }
 
 cbtl::blocks::access cbtl::blocks::access::construct(CryptoPP::AutoSeededRandomPool& rng, const cbtl::blocks::params& p, const cbtl::keys::identity::private_key& master, const CryptoPP::Integer& active_request, const CryptoPP::Integer& gaccess, const CryptoPP::Integer& passive_forward_last, const cbtl::keys::view_key& view, const std::string message) {
+    CryptoPP::Integer active_next;
+    return construct(rng, p, master, active_request, gaccess, passive_forward_last, view, message, active_next);
+}
+
+cbtl::blocks::access cbtl::blocks::access::construct(CryptoPP::AutoSeededRandomPool& rng, const cbtl::blocks::params& p, const cbtl::keys::identity::private_key& master, const CryptoPP::Integer& active_request, const CryptoPP::Integer& gaccess, const CryptoPP::Integer& passive_forward_last, const cbtl::keys::view_key& view, const std::string message, CryptoPP::Integer& active_next) {
     auto G = master.G();
     auto Gp = G.Gp();
 
@@ -68,6 +72,7 @@ cbtl::blocks::access cbtl::blocks::access::construct(CryptoPP::AutoSeededRandomP
 
     auto active  = parts::active::construct(p.a(), master, ru, rv);
     auto passive = parts::passive::construct(p.p(), cbtl::utils::sha512::digest(gaccess, CryptoPP::Integer::UNSIGNED), ru, rv, passive_forward_last, master);
+    active_next  = Gp.Exponentiate(p.a().pub().y(), ru);
 
     auto suffix = Gp.Exponentiate(Gp.Multiply(Gp.Exponentiate(G.g(), view.secret()),  gaccess), master.x());
 
@@ -84,56 +89,3 @@ cbtl::blocks::access cbtl::blocks::access::construct(CryptoPP::AutoSeededRandomP
 
     return access(active, passive, addr, contents, p.requested());
 }
-
-cbtl::blocks::access cbtl::blocks::genesis(cbtl::storage& db, const cbtl::keys::identity::public_key& pub){
-    return db.fetch(pub.genesis_id());
-}
-
-cbtl::blocks::access cbtl::blocks::last::active(cbtl::storage& db, const cbtl::keys::identity::public_key& pub, const cbtl::keys::identity::private_key& pri){
-    cbtl::blocks::access last = cbtl::blocks::genesis(db, pub);
-    while(true){
-        std::string address = last.active().next(pub.G(), last.address().id(), pri);
-        if(db.exists(address, true)){
-            std::string block_id = db.id(address);
-            last = db.fetch(block_id);
-        }else{
-            break;
-        }
-    }
-
-    return last;
-}
-
-cbtl::blocks::access cbtl::blocks::last::passive(cbtl::storage& db, const cbtl::keys::identity::public_key& pub, const cbtl::keys::identity::private_key& secret){
-    cbtl::blocks::access last = cbtl::blocks::genesis(db, pub);
-    while(true){
-        std::string address = last.passive().next(pub.G(), last.address().id(), secret);
-        if(db.exists(address, true)){
-            std::string block_id = db.id(address);
-            last = db.fetch(block_id);
-        }else{
-            break;
-        }
-    }
-    return last;
-}
-
-cbtl::blocks::access cbtl::blocks::last::passive(cbtl::storage& db, const cbtl::keys::identity::public_key& pub, const CryptoPP::Integer& gaccess, const cbtl::keys::identity::private_key& master){
-    CryptoPP::Integer h = cbtl::utils::sha512::digest(gaccess, CryptoPP::Integer::UNSIGNED);
-    cbtl::blocks::access last = cbtl::blocks::genesis(db, pub);
-    while(true){
-        std::string address = last.passive().next(pub.G(), last.address().id(), h, master);
-        if(db.exists(address, true)){
-            // std::cout << "cbtl::blocks::access cbtl::blocks::last::passive: " << "next" << std::endl;
-            std::string block_id = db.id(address);
-            last = db.fetch(block_id);
-        }else{
-            // std::cout << "cbtl::blocks::access cbtl::blocks::last::passive: " << "end" << std::endl;
-            break;
-        }
-    }
-    return last;
-}
-
-
-
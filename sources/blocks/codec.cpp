@@ -0,0 +1,146 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "cbtl/blocks/codec.h"
+#include "cbtl/blocks/access.h"
+#include "cbtl/blocks/io.h"
+#include "cbtl/compression.h"
+#include <stdexcept>
+
+namespace{
+    constexpr char        magic[2]    = {'C', 'B'};
+    constexpr std::size_t header_size = 4;
+
+    const boost::posix_time::ptime& epoch(){
+        static const boost::posix_time::ptime e(boost::gregorian::date(1970, 1, 1));
+        return e;
+    }
+
+    bool is_signed(cbtl::blocks::view::field f){
+        return f == cbtl::blocks::view::field::random_x || f == cbtl::blocks::view::field::random_y;
+    }
+
+    template <typename T>
+    void put(std::string& out, T value){
+        for(int shift = (sizeof(T) - 1) * 8; shift >= 0; shift -= 8){
+            out.push_back(static_cast<char>((static_cast<std::uint64_t>(value) >> shift) & 0xFF));
+        }
+    }
+
+    void put(std::string& out, const CryptoPP::Integer& value, CryptoPP::Integer::Signedness signedness){
+        std::size_t size = value.MinEncodedSize(signedness);
+        if(size > 0xFFFF){
+            throw std::length_error("integer too large to encode");
+        }
+        put<std::uint16_t>(out, size);
+        std::size_t offset = out.size();
+        out.resize(offset + size);
+        value.Encode(reinterpret_cast<CryptoPP::byte*>(&out[offset]), size, signedness);
+    }
+
+    struct reader{
+        std::string_view data;
+        std::size_t      offset;
+
+        std::string_view take(std::size_t size){
+            if(data.size() - offset < size){
+                throw std::invalid_argument("truncated block");
+            }
+            std::string_view bytes = data.substr(offset, size);
+            offset += size;
+            return bytes;
+        }
+        template <typename T>
+        T get(){
+            std::string_view bytes = take(sizeof(T));
+            std::uint64_t value = 0;
+            for(char c: bytes){
+                value = (value << 8) | static_cast<std::uint8_t>(c);
+            }
+            return static_cast<T>(value);
+        }
+    };
+}
+
+std::string cbtl::blocks::codec::serialize(const cbtl::blocks::access& block){
+    std::string out;
+    out.reserve(16 * 130 + block.body().ciphertext().size());
+    out.append(magic, sizeof(magic));
+    out.push_back(static_cast<char>(version));
+    out.push_back(0);
+
+    // same order as view::field
+    put(out, block.active().forward(),  CryptoPP::Integer::UNSIGNED);
+    put(out, block.active().backward(), CryptoPP::Integer::UNSIGNED);
+    put(out, block.active().checksum(), CryptoPP::Integer::UNSIGNED);
+    put(out, block.passive().forward(),  CryptoPP::Integer::UNSIGNED);
+    put(out, block.passive().backward(), CryptoPP::Integer::UNSIGNED);
+    put(out, block.passive().cipher(),   CryptoPP::Integer::UNSIGNED);
+    put(out, block.address().active(),  CryptoPP::Integer::UNSIGNED);
+    put(out, block.address().passive(), CryptoPP::Integer::UNSIGNED);
+    put(out, block.body().random().x(), CryptoPP::Integer::SIGNED);
+    put(out, block.body().random().y(), CryptoPP::Integer::SIGNED);
+    put(out, block.body().gamma(), CryptoPP::Integer::UNSIGNED);
+    put(out, block.body().super(), CryptoPP::Integer::UNSIGNED);
+
+    put<std::int64_t>(out, (block.requested() - epoch()).total_microseconds());
+    const std::string& message = block.body().ciphertext();
+    put<std::uint32_t>(out, message.size());
+    out.append(message);
+    return out;
+}
+
+cbtl::blocks::access cbtl::blocks::codec::deserialize(std::string_view data){
+    if(binary(data)){
+        return cbtl::blocks::view(data).block();
+    }
+    return nlohmann::json::parse(data.begin(), data.end()).get<cbtl::blocks::access>();
+}
+
+std::string cbtl::blocks::codec::serialize(const cbtl::blocks::access& block, cbtl::compressor& compressor){
+    return compressor.pack(serialize(block));
+}
+
+cbtl::blocks::access cbtl::blocks::codec::deserialize(std::string_view data, cbtl::compressor& compressor){
+    std::string buffer;
+    return deserialize(compressor.unpack(data, buffer));
+}
+
+bool cbtl::blocks::codec::binary(std::string_view data){
+    return data.size() >= header_size && data[0] == magic[0] && data[1] == magic[1];
+}
+
+cbtl::blocks::view::view(std::string_view data): _data(data){
+    if(!codec::binary(data)){
+        throw std::invalid_argument("not a binary block");
+    }
+    if(cbtl::compressor::compressed(data)){
+        throw std::invalid_argument("compressed block");
+    }
+    if(version() != codec::version){
+        throw std::invalid_argument("unknown block version " + std::to_string(version()));
+    }
+    reader r{data, header_size};
+    for(std::string_view& f: _fields){
+        f = r.take(r.get<std::uint16_t>());
+    }
+    _requested = r.get<std::int64_t>();
+    _message   = r.take(r.get<std::uint32_t>());
+}
+
+CryptoPP::Integer cbtl::blocks::view::integer(field f) const{
+    std::string_view bytes = raw(f);
+    return CryptoPP::Integer(reinterpret_cast<const CryptoPP::byte*>(bytes.data()), bytes.size(), is_signed(f) ? CryptoPP::Integer::SIGNED : CryptoPP::Integer::UNSIGNED);
+}
+
+boost::posix_time::ptime cbtl::blocks::view::requested() const{
+    return epoch() + boost::posix_time::microseconds(_requested);
+}
+
+cbtl::blocks::access cbtl::blocks::view::block() const{
+    parts::active  active (integer(field::active_forward),  integer(field::active_backward),  integer(field::active_checksum));
+    parts::passive passive(integer(field::passive_forward), integer(field::passive_backward), integer(field::passive_cipher));
+    addresses      address(integer(field::address_active),  integer(field::address_passive));
+    contents       body(cbtl::math::free_coordinates(integer(field::random_x), integer(field::random_y)), integer(field::gamma), integer(field::super), std::string(_message));
+    return access(active, passive, address, body, requested());
+}
@@ -0,0 +1,51 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "cbtl/bloom.h"
+#include <cmath>
+#include <algorithm>
+#include <functional>
+
+namespace{
+    std::uint64_t mix(std::uint64_t x){
+        // splitmix64 finalizer, derives the second hash from the first
+        x += 0x9E3779B97F4A7C15ull;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    }
+}
+
+cbtl::bloom_filter::bloom_filter(std::size_t expected, double rate): _count(0){
+    expected = std::max<std::size_t>(expected, 1024);
+    rate     = std::clamp(rate, 1e-9, 0.5);
+    const double ln2 = std::log(2.0);
+    std::size_t bits = static_cast<std::size_t>(std::ceil(-static_cast<double>(expected) * std::log(rate) / (ln2 * ln2)));
+    std::size_t words = (bits + 63) / 64;
+    _bits   = words * 64;
+    _hashes = std::clamp<std::size_t>(static_cast<std::size_t>(std::round(static_cast<double>(_bits) / expected * ln2)), 1, 16);
+    _words  = std::make_unique<std::atomic<std::uint64_t>[]>(words);
+    for(std::size_t i = 0; i < words; ++i){
+        _words[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void cbtl::bloom_filter::insert(const std::string& key){
+    std::uint64_t h1 = std::hash<std::string>{}(key), h2 = mix(h1) | 1;
+    for(std::size_t i = 0; i < _hashes; ++i){
+        std::size_t bit = (h1 + i * h2) % _bits;
+        _words[bit / 64].fetch_or(std::uint64_t(1) << (bit % 64), std::memory_order_release);
+    }
+    _count.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool cbtl::bloom_filter::possibly(const std::string& key) const{
+    std::uint64_t h1 = std::hash<std::string>{}(key), h2 = mix(h1) | 1;
+    for(std::size_t i = 0; i < _hashes; ++i){
+        std::size_t bit = (h1 + i * h2) % _bits;
+        if(!(_words[bit / 64].load(std::memory_order_acquire) & (std::uint64_t(1) << (bit % 64)))){
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,60 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "cbtl/buffers.h"
+#include <vector>
+#include <algorithm>
+
+cbtl::buffer::buffer(std::size_t size): _data(new char[size]), _capacity(size), _size(size) {}
+cbtl::buffer::buffer(buffer&& other) noexcept: _data(std::move(other._data)), _capacity(other._capacity), _size(other._size) {
+    other._capacity = 0;
+    other._size = 0;
+}
+
+cbtl::buffer& cbtl::buffer::operator=(buffer&& other) noexcept{
+    _data     = std::move(other._data);
+    _capacity = other._capacity;
+    _size     = other._size;
+    other._capacity = 0;
+    other._size = 0;
+    return *this;
+}
+
+void cbtl::buffer::resize(std::size_t n){
+    if(n > _capacity){
+        _data.reset(new char[n]);
+        _capacity = n;
+    }
+    _size = n;
+}
+
+namespace{
+    thread_local std::vector<cbtl::buffer> free_buffers;
+}
+
+cbtl::buffer cbtl::buffer_pool::acquire(std::size_t size){
+    // smallest retained buffer that fits, otherwise the largest one which gets reallocated
+    auto fits = free_buffers.end();
+    for(auto it = free_buffers.begin(); it != free_buffers.end(); ++it){
+        if(it->capacity() >= size && (fits == free_buffers.end() || it->capacity() < fits->capacity())){
+            fits = it;
+        }
+    }
+    if(fits == free_buffers.end()){
+        fits = std::max_element(free_buffers.begin(), free_buffers.end(), [](const buffer& l, const buffer& r){ return l.capacity() < r.capacity(); });
+    }
+    if(fits == free_buffers.end()){
+        return buffer(size);
+    }
+    buffer buff = std::move(*fits);
+    free_buffers.erase(fits);
+    buff.resize(size);
+    return buff;
+}
+
+void cbtl::buffer_pool::release(buffer&& buff){
+    if(buff.capacity() == 0 || buff.capacity() > max_retained || free_buffers.size() >= max_buffers){
+        return;
+    }
+    free_buffers.push_back(std::move(buff));
+}
@@ -0,0 +1,73 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "cbtl/cache.h"
+#include <functional>
+
+cbtl::block_cache::block_cache(std::size_t capacity): _capacity((capacity + shards - 1) / shards), _hits(0), _misses(0), _evictions(0) { }
+
+cbtl::block_cache::shard& cbtl::block_cache::locate(const std::string& id){
+    return _shards[std::hash<std::string>{}(id) % shards];
+}
+
+std::optional<cbtl::blocks::access> cbtl::block_cache::get(const std::string& id){
+    if(!enabled()){
+        return std::nullopt;
+    }
+    value_type value;
+    {
+        shard& s = locate(id);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto it = s.index.find(id);
+        if(it != s.index.end()){
+            s.order.splice(s.order.begin(), s.order, it->second);
+            value = it->second->second;
+        }
+    }
+    if(!value){
+        _misses.fetch_add(1, std::memory_order_relaxed);
+        return std::nullopt;
+    }
+    _hits.fetch_add(1, std::memory_order_relaxed);
+    // copied outside the lock
+    return *value;
+}
+
+bool cbtl::block_cache::contains(const std::string& id){
+    if(!enabled()){
+        return false;
+    }
+    shard& s = locate(id);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    return s.index.count(id) > 0;
+}
+
+void cbtl::block_cache::put(const std::string& id, const cbtl::blocks::access& block){
+    if(!enabled()){
+        return;
+    }
+    value_type value = std::make_shared<const cbtl::blocks::access>(block);
+    shard& s = locate(id);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto it = s.index.find(id);
+    if(it != s.index.end()){
+        s.order.splice(s.order.begin(), s.order, it->second);
+        return;
+    }
+    s.order.emplace_front(id, std::move(value));
+    s.index.emplace(id, s.order.begin());
+    if(s.order.size() > _capacity){
+        s.index.erase(s.order.back().first);
+        s.order.pop_back();
+        _evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+cbtl::block_cache::statistics cbtl::block_cache::stats(){
+    statistics st{_hits.load(std::memory_order_relaxed), _misses.load(std::memory_order_relaxed), _evictions.load(std::memory_order_relaxed), 0};
+    for(shard& s: _shards){
+        std::lock_guard<std::mutex> lock(s.mutex);
+        st.size += s.order.size();
+    }
+    return st;
+}
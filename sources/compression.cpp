@@ -0,0 +1,148 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "cbtl/compression.h"
+#include "cbtl/blocks/codec.h"
+#include <chrono>
+#include <memory>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#if defined(CBTL_WITH_ZSTD)
+#include <zstd.h>
+#endif
+
+namespace{
+    constexpr std::size_t header_size = 4;   ///< codec header, magic "CB" | version | flags
+    constexpr std::size_t size_size   = 4;   ///< u32 size of the encoded body
+
+    std::uint64_t since(std::chrono::steady_clock::time_point start){
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+#if defined(CBTL_WITH_ZSTD)
+    /**
+     * @brief zstd contexts are not thread safe, every thread keeps its own
+     */
+    ZSTD_CCtx* cctx(){
+        thread_local std::unique_ptr<ZSTD_CCtx, std::size_t (*)(ZSTD_CCtx*)> context(ZSTD_createCCtx(), &ZSTD_freeCCtx);
+        return context.get();
+    }
+    ZSTD_DCtx* dctx(){
+        thread_local std::unique_ptr<ZSTD_DCtx, std::size_t (*)(ZSTD_DCtx*)> context(ZSTD_createDCtx(), &ZSTD_freeDCtx);
+        return context.get();
+    }
+#endif
+}
+
+cbtl::compressor::compressor(const cbtl::config& config): _level(config.compression), _cdict(0x0), _ddict(0x0), _limit(config.max_frame), _packed(0), _raw(0), _stored(0), _pack_time(0), _unpacked(0), _unpack_time(0) {
+#if defined(CBTL_WITH_ZSTD)
+    if(!config.compression_dict.empty()){
+        std::ifstream in(config.compression_dict, std::ios::binary);
+        if(!in){
+            throw std::runtime_error("compression: cannot read dictionary " + config.compression_dict);
+        }
+        std::string dictionary((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        _ddict = ZSTD_createDDict(dictionary.data(), dictionary.size());
+        if(_level > 0){
+            _cdict = ZSTD_createCDict(dictionary.data(), dictionary.size(), _level);
+        }
+        if(!_ddict || (_level > 0 && !_cdict)){
+            throw std::runtime_error("compression: invalid dictionary " + config.compression_dict);
+        }
+    }
+#else
+    if(_level > 0 || !config.compression_dict.empty()){
+        throw std::invalid_argument("compression: cbtl was built without zstd");
+    }
+#endif
+}
+
+cbtl::compressor::~compressor(){
+#if defined(CBTL_WITH_ZSTD)
+    ZSTD_freeCDict(static_cast<ZSTD_CDict*>(_cdict));
+    ZSTD_freeDDict(static_cast<ZSTD_DDict*>(_ddict));
+#endif
+}
+
+bool cbtl::compressor::compressed(std::string_view data){
+    // a block stored as JSON has no codec header, its fourth byte may well have the flag bit set
+    return cbtl::blocks::codec::binary(data) && (static_cast<std::uint8_t>(data[3]) & flag);
+}
+
+std::string cbtl::compressor::pack(std::string encoded){
+#if defined(CBTL_WITH_ZSTD)
+    if(_level <= 0 || encoded.size() <= header_size){
+        return encoded;
+    }
+    auto start = std::chrono::steady_clock::now();
+    std::string_view body = std::string_view(encoded).substr(header_size);
+    std::string out;
+    out.resize(header_size + size_size + ZSTD_compressBound(body.size()));
+    std::size_t size = _cdict ? ZSTD_compress_usingCDict(cctx(), &out[header_size + size_size], out.size() - header_size - size_size, body.data(), body.size(), static_cast<const ZSTD_CDict*>(_cdict))
+                              : ZSTD_compressCCtx(cctx(), &out[header_size + size_size], out.size() - header_size - size_size, body.data(), body.size(), _level);
+    if(ZSTD_isError(size)){
+        throw std::runtime_error(std::string("compression: ") + ZSTD_getErrorName(size));
+    }
+    if(size + size_size >= body.size()){
+        // ciphertext heavy blocks may not shrink, they are stored as they are but still count towards the ratio
+        _raw       += encoded.size();
+        _stored    += encoded.size();
+        _pack_time += since(start);
+        return encoded;
+    }
+    out.resize(header_size + size_size + size);
+    out.replace(0, header_size, encoded, 0, header_size);
+    out[3] = static_cast<char>(static_cast<std::uint8_t>(out[3]) | flag);
+    std::uint32_t body_size = body.size();
+    for(std::size_t i = 0; i < size_size; ++i){
+        out[header_size + i] = static_cast<char>((body_size >> (8 * (size_size - 1 - i))) & 0xFF);
+    }
+    _packed      += 1;
+    _raw         += encoded.size();
+    _stored      += out.size();
+    _pack_time   += since(start);
+    return out;
+#else
+    return encoded;
+#endif
+}
+
+std::string_view cbtl::compressor::unpack(std::string_view data, std::string& buffer){
+    if(!compressed(data)){
+        return data;
+    }
+#if defined(CBTL_WITH_ZSTD)
+    if(data.size() < header_size + size_size){
+        throw std::invalid_argument("compression: truncated block");
+    }
+    auto start = std::chrono::steady_clock::now();
+    std::uint32_t body_size = 0;
+    for(std::size_t i = 0; i < size_size; ++i){
+        body_size = (body_size << 8) | static_cast<std::uint8_t>(data[header_size + i]);
+    }
+    std::string_view frame = data.substr(header_size + size_size);
+    // the size is read from the stored value, it is checked against the frame before anything is allocated for it
+    unsigned long long content_size = ZSTD_getFrameContentSize(frame.data(), frame.size());
+    if(content_size != body_size || body_size > _limit){
+        throw std::invalid_argument("compression: corrupt block");
+    }
+    buffer.resize(header_size + body_size);
+    std::size_t size = _ddict ? ZSTD_decompress_usingDDict(dctx(), &buffer[header_size], body_size, frame.data(), frame.size(), static_cast<const ZSTD_DDict*>(_ddict))
+                              : ZSTD_decompressDCtx(dctx(), &buffer[header_size], body_size, frame.data(), frame.size());
+    if(ZSTD_isError(size) || size != body_size){
+        throw std::runtime_error(std::string("compression: corrupt block ") + (ZSTD_isError(size) ? ZSTD_getErrorName(size) : "size mismatch"));
+    }
+    buffer.replace(0, header_size, data.substr(0, header_size));
+    buffer[3] = static_cast<char>(static_cast<std::uint8_t>(buffer[3]) & ~flag);
+    _unpacked    += 1;
+    _unpack_time += since(start);
+    return buffer;
+#else
+    throw std::runtime_error("compression: compressed block but cbtl was built without zstd");
+#endif
+}
+
+cbtl::compressor::statistics cbtl::compressor::stats() const{
+    return statistics{_packed.load(), _raw.load(), _stored.load(), _pack_time.load(), _unpacked.load(), _unpack_time.load()};
+}
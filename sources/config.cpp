@@ -0,0 +1,18 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "cbtl/config.h"
+#include <boost/program_options/value_semantic.hpp>
+
+boost::program_options::options_description cbtl::config::storage_options(){
+    boost::program_options::options_description desc("Storage");
+    desc.add_options()
+        ("engine",           boost::program_options::value<std::string>(&engine)->default_value(engine), "storage engine (redis, bdb, lmdb or memory) when built with CBTL_STORAGE=any")
+        ("storage",          boost::program_options::value<std::string>(&path)->default_value(path), "directory of the file backed storage engines")
+        ("redis",            boost::program_options::value<std::vector<std::string>>(&redis)->multitoken()->default_value(redis, "127.0.0.1:6379"), "redis instances (host:port) the keys are sharded over")
+        ("address-digest",   boost::program_options::value<std::size_t>(&address_digest)->default_value(address_digest), "bytes of SHA-256 the redis address keys are truncated to, 0 keeps the whole address")
+        ("compression",      boost::program_options::value<int>(&compression)->default_value(compression), "zstd level the stored blocks are compressed at, 0 stores them uncompressed")
+        ("compression-dict", boost::program_options::value<std::string>(&compression_dict), "zstd dictionary of the stored blocks (zstd --train)")
+    ;
+    return desc;
+}
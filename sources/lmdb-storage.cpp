@@ -0,0 +1,188 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "cbtl/lmdb-storage.h"
+#include "cbtl/blocks.h"
+#include "cbtl/blocks/io.h"
+#include "cbtl/blocks/codec.h"
+#include <filesystem>
+
+namespace{
+    MDB_val value_of(std::string_view data){
+        MDB_val v;
+        v.mv_size = data.size();
+        v.mv_data = const_cast<char*>(data.data());
+        return v;
+    }
+}
+
+void cbtl::engines::lmdb::check(int rc, const char* what){
+    if(rc != MDB_SUCCESS){
+        throw std::runtime_error(std::string("lmdb: ") + what + ": " + mdb_strerror(rc));
+    }
+}
+
+cbtl::engines::lmdb::transaction::transaction(MDB_env* env, bool readonly): _txn(0x0){
+    check(mdb_txn_begin(env, 0x0, readonly ? MDB_RDONLY : 0, &_txn), "txn_begin");
+}
+
+cbtl::engines::lmdb::transaction::~transaction(){
+    if(_txn){
+        mdb_txn_abort(_txn);
+    }
+}
+
+void cbtl::engines::lmdb::transaction::commit(){
+    MDB_txn* txn = _txn;
+    _txn = 0x0;
+    check(mdb_txn_commit(txn), "txn_commit");
+}
+
+cbtl::engines::lmdb::lmdb(const cbtl::config& config): _compressor(config), _env(0x0){
+    const std::string& path = config.path;
+    std::filesystem::path env_dir(path);
+    if(!std::filesystem::exists(env_dir) || !std::filesystem::is_directory(env_dir)){
+        std::filesystem::create_directory(env_dir);
+    }
+    check(mdb_env_create(&_env), "env_create");
+    try{
+        check(mdb_env_set_maxdbs(_env, 2), "env_set_maxdbs");
+        check(mdb_env_set_mapsize(_env, map_size), "env_set_mapsize");
+        // MDB_NOTLS: read transactions are not tied to a thread, the sessions hop between threads
+        check(mdb_env_open(_env, path.c_str(), MDB_NOTLS, 0664), "env_open");
+        transaction txn(_env, false);
+        check(mdb_dbi_open(txn.get(), "blocks",  MDB_CREATE, &_blocks), "dbi_open blocks");
+        check(mdb_dbi_open(txn.get(), "indexes", MDB_CREATE, &_index),  "dbi_open indexes");
+        txn.commit();
+    }catch(...){
+        mdb_env_close(_env);
+        throw;
+    }
+}
+
+cbtl::engines::lmdb::~lmdb(){
+    mdb_env_close(_env);
+}
+
+bool cbtl::engines::lmdb::get(MDB_txn* txn, MDB_dbi dbi, std::string_view key, std::string_view& value){
+    MDB_val k = value_of(key), v;
+    int rc = mdb_get(txn, dbi, &k, &v);
+    if(rc == MDB_NOTFOUND){
+        return false;
+    }
+    check(rc, "get");
+    value = std::string_view(static_cast<const char*>(v.mv_data), v.mv_size);
+    return true;
+}
+
+bool cbtl::engines::lmdb::insert(MDB_txn* txn, const cbtl::blocks::access& block){
+    std::string block_id = block.address().hash();
+    std::string block_str = cbtl::blocks::codec::serialize(block, _compressor);
+    std::string active_address  = cbtl::utils::hex::encode(block.address().active(),  CryptoPP::Integer::UNSIGNED);
+    std::string passive_address = cbtl::utils::hex::encode(block.address().passive(), CryptoPP::Integer::UNSIGNED);
+
+    // all or nothing like MSETNX, nothing is put unless none of the three keys exist
+    std::string_view existing;
+    if(get(txn, _blocks, block_id, existing) || get(txn, _index, active_address, existing) || get(txn, _index, passive_address, existing)){
+        return false;
+    }
+    MDB_val id = value_of(block_id), value = value_of(block_str);
+    check(mdb_put(txn, _blocks, &id, &value, MDB_NOOVERWRITE), "put block");
+    for(const std::string& address: {active_address, passive_address}){
+        MDB_val key = value_of(address), target = value_of(block_id);
+        check(mdb_put(txn, _index, &key, &target, MDB_NOOVERWRITE), "put address");
+    }
+    return true;
+}
+
+bool cbtl::engines::lmdb::add(const cbtl::blocks::access& block){
+    transaction txn(_env, false);
+    if(!insert(txn.get(), block)){
+        return false;
+    }
+    txn.commit();
+    return true;
+}
+
+std::vector<bool> cbtl::engines::lmdb::add_batch(const std::vector<cbtl::blocks::access>& blocks){
+    transaction txn(_env, false);
+    std::vector<bool> ok(blocks.size(), false);
+    for(std::size_t i = 0; i < blocks.size(); ++i){
+        ok[i] = insert(txn.get(), blocks[i]);
+    }
+    txn.commit();
+    return ok;
+}
+
+bool cbtl::engines::lmdb::exists(const std::string& id, bool index){
+    transaction txn(_env, true);
+    std::string_view value;
+    return get(txn.get(), index ? _index : _blocks, id, value);
+}
+
+std::string cbtl::engines::lmdb::id(const std::string& addr){
+    transaction txn(_env, true);
+    std::string_view value;
+    if(!get(txn.get(), _index, addr, value)){
+        throw std::out_of_range("address "+ addr + " not found");
+    }
+    return std::string(value);
+}
+
+cbtl::blocks::access cbtl::engines::lmdb::fetch(const std::string& block_id){
+    // decoded straight out of the map, the binary codec reads the integers in place
+    return view(block_id, [this](std::string_view value){
+        return cbtl::blocks::codec::deserialize(value, _compressor);
+    });
+}
+
+void cbtl::engines::lmdb::scan_blocks(const std::function<void (const cbtl::blocks::access&)>& f){
+    transaction txn(_env, true);
+    MDB_cursor* cursor;
+    check(mdb_cursor_open(txn.get(), _blocks, &cursor), "cursor_open");
+    MDB_val key, value;
+    int rc = mdb_cursor_get(cursor, &key, &value, MDB_FIRST);
+    try{
+        while(rc == MDB_SUCCESS){
+            f(cbtl::blocks::codec::deserialize(std::string_view(static_cast<const char*>(value.mv_data), value.mv_size), _compressor));
+            rc = mdb_cursor_get(cursor, &key, &value, MDB_NEXT);
+        }
+    }catch(...){
+        mdb_cursor_close(cursor);
+        throw;
+    }
+    mdb_cursor_close(cursor);
+    if(rc != MDB_NOTFOUND){
+        check(rc, "cursor_get");
+    }
+}
+
+std::optional<cbtl::blocks::access> cbtl::engines::lmdb::resolve(const std::string& address){
+    transaction txn(_env, true);
+    std::string_view block_id, value;
+    if(!get(txn.get(), _index, address, block_id) || !get(txn.get(), _blocks, block_id, value)){
+        return std::nullopt;
+    }
+    return cbtl::blocks::codec::deserialize(value, _compressor);
+}
+
+void cbtl::engines::lmdb::scan_addresses(const std::function<void (const std::string&)>& f){
+    transaction txn(_env, true);
+    MDB_cursor* cursor;
+    check(mdb_cursor_open(txn.get(), _index, &cursor), "cursor_open");
+    MDB_val key, value;
+    int rc = mdb_cursor_get(cursor, &key, &value, MDB_FIRST);
+    try{
+        while(rc == MDB_SUCCESS){
+            f(std::string(static_cast<const char*>(key.mv_data), key.mv_size));
+            rc = mdb_cursor_get(cursor, &key, &value, MDB_NEXT);
+        }
+    }catch(...){
+        mdb_cursor_close(cursor);
+        throw;
+    }
+    mdb_cursor_close(cursor);
+    if(rc != MDB_NOTFOUND){
+        check(rc, "cursor_get");
+    }
+}
@@ -0,0 +1,153 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "cbtl/memory-storage.h"
+#include "cbtl/blocks.h"
+#include "cbtl/blocks/io.h"
+#include "cbtl/blocks/codec.h"
+#include <mutex>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+#include <stdexcept>
+#include <unistd.h>
+
+cbtl::engines::memory::memory(const cbtl::config& config): _compressor(config), _dirty(false) {
+    if(!config.path.empty()){
+        _file = (std::filesystem::path(config.path) / "memory.ledger").string();
+        load();
+        _dirty = false;
+    }
+}
+
+cbtl::engines::memory::~memory(){
+    if(!_file.empty() && _dirty){
+        try{
+            save();
+        }catch(const std::exception& ex){
+            std::cout << "memory: failed to save " << _file << ": " << ex.what() << std::endl;
+        }
+    }
+}
+
+bool cbtl::engines::memory::insert(const cbtl::blocks::access& block){
+    std::string block_id = block.address().hash();
+    std::string active_address  = cbtl::utils::hex::encode(block.address().active(),  CryptoPP::Integer::UNSIGNED);
+    std::string passive_address = cbtl::utils::hex::encode(block.address().passive(), CryptoPP::Integer::UNSIGNED);
+    // all or nothing like MSETNX
+    if(_blocks.count(block_id) || _index.count(active_address) || _index.count(passive_address)){
+        return false;
+    }
+    _blocks.emplace(block_id, cbtl::blocks::codec::serialize(block, _compressor));
+    _index.emplace(active_address,  block_id);
+    _index.emplace(passive_address, block_id);
+    _dirty = true;
+    return true;
+}
+
+bool cbtl::engines::memory::add(const cbtl::blocks::access& block){
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    return insert(block);
+}
+
+std::vector<bool> cbtl::engines::memory::add_batch(const std::vector<cbtl::blocks::access>& blocks){
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    std::vector<bool> ok(blocks.size(), false);
+    for(std::size_t i = 0; i < blocks.size(); ++i){
+        ok[i] = insert(blocks[i]);
+    }
+    return ok;
+}
+
+bool cbtl::engines::memory::exists(const std::string& id, bool index){
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    return index ? _index.count(id) > 0 : _blocks.count(id) > 0;
+}
+
+std::string cbtl::engines::memory::id(const std::string& addr){
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    auto it = _index.find(addr);
+    if(it == _index.end()){
+        throw std::out_of_range("address "+ addr + " not found");
+    }
+    return it->second;
+}
+
+cbtl::blocks::access cbtl::engines::memory::fetch(const std::string& block_id){
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    auto it = _blocks.find(block_id);
+    if(it == _blocks.end()){
+        throw std::out_of_range("block "+ block_id + " not found");
+    }
+    return cbtl::blocks::codec::deserialize(it->second, _compressor);
+}
+
+std::optional<cbtl::blocks::access> cbtl::engines::memory::resolve(const std::string& address){
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    auto it = _index.find(address);
+    if(it == _index.end()){
+        return std::nullopt;
+    }
+    auto block = _blocks.find(it->second);
+    if(block == _blocks.end()){
+        return std::nullopt;
+    }
+    return cbtl::blocks::codec::deserialize(block->second, _compressor);
+}
+
+void cbtl::engines::memory::scan_addresses(const std::function<void (const std::string&)>& f){
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    for(const auto& entry: _index){
+        f(entry.first);
+    }
+}
+
+void cbtl::engines::memory::scan_blocks(const std::function<void (const cbtl::blocks::access&)>& f){
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    for(const auto& entry: _blocks){
+        f(cbtl::blocks::codec::deserialize(entry.second, _compressor));
+    }
+}
+
+void cbtl::engines::memory::load(){
+    std::ifstream in(_file, std::ios::binary);
+    if(!in){
+        return;
+    }
+    // a sequence of (u32 length, serialized block), the index is rebuilt from the blocks
+    std::string block_str;
+    std::uint8_t size_bytes[4];
+    while(in.read(reinterpret_cast<char*>(size_bytes), sizeof(size_bytes))){
+        std::uint32_t size = (std::uint32_t(size_bytes[0]) << 24) | (std::uint32_t(size_bytes[1]) << 16) | (std::uint32_t(size_bytes[2]) << 8) | size_bytes[3];
+        block_str.resize(size);
+        if(!in.read(block_str.data(), size)){
+            throw std::runtime_error("memory: truncated ledger " + _file);
+        }
+        insert(cbtl::blocks::codec::deserialize(block_str, _compressor));
+    }
+}
+
+void cbtl::engines::memory::save(){
+    std::filesystem::path file(_file);
+    std::filesystem::create_directories(file.parent_path());
+    // the ledger is replaced in one rename, a failed or concurrent write never leaves it half written
+    std::filesystem::path temporary = file;
+    // one temporary per process, so that two processes saving at once do not write into the same file
+    temporary += ".tmp." + std::to_string(::getpid());
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        std::shared_lock<std::shared_mutex> lock(_mutex);
+        for(const auto& entry: _blocks){
+            std::uint32_t size = entry.second.size();
+            std::uint8_t size_bytes[4] = {std::uint8_t(size >> 24), std::uint8_t(size >> 16), std::uint8_t(size >> 8), std::uint8_t(size)};
+            out.write(reinterpret_cast<const char*>(size_bytes), sizeof(size_bytes));
+            out.write(entry.second.data(), entry.second.size());
+        }
+        out.close();
+        if(!out){
+            std::filesystem::remove(temporary);
+            throw std::runtime_error("memory: failed to write " + temporary.string());
+        }
+    }
+    std::filesystem::rename(temporary, file);
+}
@@ -5,7 +5,6 @@
 #include "cbtl/utils.h"
 #include "cbtl/keys.h"
 #include "cbtl/blocks/access.h"
-#include "cbtl/redis-storage.h"
 
 cbtl::packets::request cbtl::packets::request::construct(const cbtl::blocks::access& block, const cbtl::keys::identity::pair& keys){
     cbtl::packets::request req;
@@ -15,10 +14,6 @@ cbtl::packets::request cbtl::packets::request::construct(const cbtl::blocks::acc
     return req;
 }
 
-cbtl::packets::request cbtl::packets::request::construct(cbtl::storage& db, const cbtl::keys::identity::pair& keys){
-    return construct(cbtl::blocks::last::active(db, keys.pub(), keys.pri()), keys);
-}
-
 
 // void cbtl::packets::to_json(nlohmann::json& j, const action_data<actions::identify>& q){
 //     j = nlohmann::json {
@@ -77,12 +72,34 @@ void cbtl::packets::to_json(nlohmann::json& j, const request& q){
         {"last",  q.last},
         {"token", cbtl::utils::hex::encode(q.token, CryptoPP::Integer::UNSIGNED)}
     };
+    if(q.resume){
+        j["resume"] = true;
+    }
 }
 
 void cbtl::packets::from_json(const nlohmann::json& j, request& q){
     q.y     = cbtl::utils::hex::decode(j["y"].get<std::string>(), CryptoPP::Integer::UNSIGNED);
     q.last  = j["last"].get<std::string>();
     q.token = cbtl::utils::hex::decode(j["token"].get<std::string>(), CryptoPP::Integer::UNSIGNED);
+    q.resume = j.value("resume", false);
+}
+
+std::string cbtl::packets::resumption::prove(const std::string& ticket, const CryptoPP::Integer& lambda){
+    return cbtl::utils::sha512::str(ticket + cbtl::utils::hex::encode(lambda, CryptoPP::Integer::UNSIGNED));
+}
+
+void cbtl::packets::to_json(nlohmann::json& j, const resumption& r){
+    j = nlohmann::json {
+        {"ticket",   r.ticket},
+        {"proof",    r.proof},
+        {"response", r.response}
+    };
+}
+
+void cbtl::packets::from_json(const nlohmann::json& j, resumption& r){
+    r.ticket   = j["ticket"].get<std::string>();
+    r.proof    = j["proof"].get<std::string>();
+    r.response = j["response"];
 }
 
 void cbtl::packets::to_json(nlohmann::json& j, const challenge& c){
@@ -119,6 +136,14 @@ cbtl::packets::result cbtl::packets::result::failure(std::uint32_t code, const s
     return res;
 }
 
+cbtl::packets::result cbtl::packets::result::busy(std::uint32_t retry_after){
+    cbtl::packets::result res = failure(503, "busy");
+    res.aux = {
+        {"retry_after", retry_after}
+    };
+    return res;
+}
+
 cbtl::packets::result cbtl::packets::result::success(const CryptoPP::Integer& active, const CryptoPP::Integer& passive, const std::string& block, const nlohmann::json& aux){
     cbtl::packets::result res;
     res.error   = 0;
@@ -0,0 +1,278 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "cbtl/redis-async-storage.h"
+#include "cbtl/blocks/io.h"
+#include "cbtl/blocks/codec.h"
+#include <iostream>
+#include <future>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+#include <boost/asio/bind_executor.hpp>
+
+namespace{
+    constexpr std::chrono::milliseconds min_backoff(100);
+    constexpr std::chrono::milliseconds max_backoff(5000);
+}
+
+cbtl::async_storage::async_storage(boost::asio::io_context& io, cbtl::compressor& compressor, const cbtl::redis_keys& keys, const std::string& host, int port): _compressor(compressor), _keys(keys), _host(host), _port(port), _strand(boost::asio::make_strand(io)), _descriptor(io), _retry(io), _backoff(min_backoff), _context(0x0), _generation(0), _closing(false), _retrying(false), _connected(false), _want_read(false), _want_write(false), _reading(false), _writing(false){
+    connect();
+}
+
+cbtl::async_storage::~async_storage(){
+    // hiredis callbacks run on the strand, so the context is freed there unless no thread runs the io_context anymore
+    if(_strand.running_in_this_thread()){
+        close();
+        return;
+    }
+    auto claimed = std::make_shared<std::atomic<bool>>(false);
+    auto freed   = std::make_shared<std::promise<void>>();
+    std::future<void> done = freed->get_future();
+    boost::asio::post(_strand, [this, claimed, freed](){
+        if(!claimed->exchange(true)){
+            close();
+            freed->set_value();
+        }
+    });
+    while(done.wait_for(std::chrono::milliseconds(10)) != std::future_status::ready){
+        if(_strand.get_inner_executor().context().stopped() && !claimed->exchange(true)){
+            close();
+            break;
+        }
+    }
+}
+
+void cbtl::async_storage::connect(){
+    _context = redisAsyncConnect(_host.c_str(), _port);
+    if(_context == 0x0 || _context->err){
+        std::string reason = _context ? std::string(_context->errstr) : std::string("allocation failed");
+        if(_context) redisAsyncFree(_context);
+        _context = 0x0;
+        throw std::runtime_error("redis: " + reason);
+    }
+    ++_generation;
+    _want_read  = false;
+    _want_write = false;
+    _reading    = false;
+    _writing    = false;
+    _context->data = this;
+    _descriptor.assign(_context->c.fd);
+
+    _context->ev.data     = this;
+    _context->ev.addRead  = &async_storage::add_read;
+    _context->ev.delRead  = &async_storage::del_read;
+    _context->ev.addWrite = &async_storage::add_write;
+    _context->ev.delWrite = &async_storage::del_write;
+    _context->ev.cleanup  = &async_storage::cleanup;
+    redisAsyncSetConnectCallback(_context, &async_storage::on_connect);
+    redisAsyncSetDisconnectCallback(_context, &async_storage::on_disconnect);
+}
+
+void cbtl::async_storage::reconnect(){
+    _connected = false;
+    if(_closing || _retrying){
+        return;
+    }
+    _retrying = true;
+    _retry.expires_after(_backoff);
+    _retry.async_wait(boost::asio::bind_executor(_strand, [this](boost::system::error_code ec){
+        if(ec == boost::asio::error::operation_aborted){
+            return;
+        }
+        _retrying = false;
+        if(_closing || _context){
+            return;
+        }
+        try{
+            connect();
+        }catch(const std::exception& ex){
+            std::cout << ex.what() << std::endl;
+            _backoff = std::min(_backoff * 2, max_backoff);
+            reconnect();
+        }
+    }));
+}
+
+void cbtl::async_storage::close(){
+    _closing   = true;
+    _connected = false;
+    _retry.cancel();
+    if(_context){
+        // invokes the outstanding callbacks with a null reply and then cleanup()
+        redisAsyncFree(_context);
+        _context = 0x0;
+    }
+}
+
+void cbtl::async_storage::submit(const std::vector<std::string>& args, std::unique_ptr<pending> op){
+    if(!_context){
+        op->complete(0x0);
+        return;
+    }
+    std::vector<const char*> argv;
+    std::vector<std::size_t> argvlen;
+    argv.reserve(args.size());
+    argvlen.reserve(args.size());
+    for(const std::string& arg: args){
+        argv.push_back(arg.data());
+        argvlen.push_back(arg.size());
+    }
+    // hiredis copies the arguments into its output buffer, ownership of op passes to the callback
+    if(redisAsyncCommandArgv(_context, &async_storage::on_reply, op.get(), argv.size(), argv.data(), argvlen.data()) == REDIS_OK){
+        op.release();
+    }else{
+        op->complete(0x0);
+    }
+}
+
+std::vector<std::string> cbtl::async_storage::add_command(const cbtl::blocks::access& block){
+    std::string block_id = block.address().hash();
+    return {
+        "MSETNX",
+        _keys.block(block_id), cbtl::blocks::codec::serialize(block, _compressor),
+        _keys.address(cbtl::utils::hex::encode(block.address().active(),  CryptoPP::Integer::UNSIGNED)), _keys.value(block_id),
+        _keys.address(cbtl::utils::hex::encode(block.address().passive(), CryptoPP::Integer::UNSIGNED)), _keys.value(block_id)
+    };
+}
+
+std::pair<boost::system::error_code, bool> cbtl::async_storage::to_bool(redisReply* reply){
+    if(!reply){
+        return {boost::asio::error::not_connected, false};
+    }
+    if(reply->type != REDIS_REPLY_INTEGER){
+        return {boost::asio::error::invalid_argument, false};
+    }
+    return {boost::system::error_code(), reply->integer == 1};
+}
+
+std::pair<boost::system::error_code, std::string> cbtl::async_storage::to_string(redisReply* reply){
+    if(!reply){
+        return {boost::asio::error::not_connected, std::string()};
+    }
+    if(reply->type == REDIS_REPLY_NIL){
+        return {boost::asio::error::not_found, std::string()};
+    }
+    if(reply->type != REDIS_REPLY_STRING){
+        return {boost::asio::error::invalid_argument, std::string()};
+    }
+    return {boost::system::error_code(), std::string(reply->str, reply->len)};
+}
+
+std::pair<boost::system::error_code, std::string> cbtl::async_storage::to_id(redisReply* reply){
+    std::pair<boost::system::error_code, std::string> value = to_string(reply);
+    if(!value.first){
+        value.second = _keys.id(value.second);
+    }
+    return value;
+}
+
+std::pair<boost::system::error_code, std::optional<cbtl::blocks::access>> cbtl::async_storage::to_block(redisReply* reply){
+    std::pair<boost::system::error_code, std::string> value = to_string(reply);
+    if(value.first){
+        return {value.first, std::nullopt};
+    }
+    try{
+        return {boost::system::error_code(), cbtl::blocks::codec::deserialize(value.second, _compressor)};
+    }catch(const std::exception& ex){
+        std::cout << "redis: malformed block: " << ex.what() << std::endl;
+        return {boost::asio::error::invalid_argument, std::nullopt};
+    }
+}
+
+void cbtl::async_storage::on_reply(redisAsyncContext* context, void* reply, void* data){
+    std::unique_ptr<pending> op(static_cast<pending*>(data));
+    op->complete(static_cast<redisReply*>(reply));
+}
+
+void cbtl::async_storage::on_connect(const redisAsyncContext* context, int status){
+    async_storage* self = static_cast<async_storage*>(context->data);
+    if(status != REDIS_OK){
+        std::cout << "redis: failed to connect: " << context->errstr << std::endl;
+        // hiredis frees the context after this callback without calling on_disconnect
+        self->_context = 0x0;
+        self->_backoff = std::min(self->_backoff * 2, max_backoff);
+        self->reconnect();
+        return;
+    }
+    self->_backoff   = min_backoff;
+    self->_connected = true;
+}
+
+void cbtl::async_storage::on_disconnect(const redisAsyncContext* context, int status){
+    async_storage* self = static_cast<async_storage*>(context->data);
+    if(status != REDIS_OK){
+        std::cout << "redis: disconnected: " << context->errstr << std::endl;
+    }
+    // hiredis frees the context after this callback
+    self->_context = 0x0;
+    self->reconnect();
+}
+
+void cbtl::async_storage::add_read(void* data){
+    async_storage* self = static_cast<async_storage*>(data);
+    self->_want_read = true;
+    self->arm_read();
+}
+
+void cbtl::async_storage::del_read(void* data){
+    static_cast<async_storage*>(data)->_want_read = false;
+}
+
+void cbtl::async_storage::add_write(void* data){
+    async_storage* self = static_cast<async_storage*>(data);
+    self->_want_write = true;
+    self->arm_write();
+}
+
+void cbtl::async_storage::del_write(void* data){
+    static_cast<async_storage*>(data)->_want_write = false;
+}
+
+void cbtl::async_storage::cleanup(void* data){
+    async_storage* self = static_cast<async_storage*>(data);
+    self->_want_read  = false;
+    self->_want_write = false;
+    boost::system::error_code ec;
+    self->_descriptor.cancel(ec);
+    // the socket belongs to hiredis
+    self->_descriptor.release();
+}
+
+void cbtl::async_storage::arm_read(){
+    if(!_want_read || _reading || !_context){
+        return;
+    }
+    _reading = true;
+    _descriptor.async_wait(boost::asio::posix::stream_descriptor::wait_read, boost::asio::bind_executor(_strand, [this, generation = _generation](boost::system::error_code ec){
+        if(generation != _generation){
+            // armed for a connection that has since been replaced
+            return;
+        }
+        _reading = false;
+        if(ec || !_context){
+            return;
+        }
+        redisAsyncHandleRead(_context);
+        arm_read();
+    }));
+}
+
+void cbtl::async_storage::arm_write(){
+    if(!_want_write || _writing || !_context){
+        return;
+    }
+    _writing = true;
+    _descriptor.async_wait(boost::asio::posix::stream_descriptor::wait_write, boost::asio::bind_executor(_strand, [this, generation = _generation](boost::system::error_code ec){
+        if(generation != _generation){
+            // armed for a connection that has since been replaced
+            return;
+        }
+        _writing = false;
+        if(ec || !_context){
+            return;
+        }
+        redisAsyncHandleWrite(_context);
+        arm_write();
+    }));
+}
@@ -0,0 +1,71 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "cbtl/redis-keys.h"
+#include <cstdint>
+#include <stdexcept>
+#include <cryptopp/sha.h>
+
+namespace{
+    const char* prefix_block   = "id:";
+    const char* prefix_address = "addr:";
+
+    int nibble(char c){
+        if(c >= '0' && c <= '9') return c - '0';
+        if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+        if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+        throw std::invalid_argument(std::string("redis: not a hex digit ") + c);
+    }
+}
+
+cbtl::redis_keys::redis_keys(std::size_t digest): _digest(digest) {
+    if(_digest != 0 && (_digest < 8 || _digest > CryptoPP::SHA256::DIGESTSIZE)){
+        throw std::invalid_argument("redis: address digest must be 0 or between 8 and 32 bytes");
+    }
+}
+
+std::string cbtl::redis_keys::block(const std::string& block_id) const{
+    return prefix_block + raw(block_id);
+}
+
+std::string cbtl::redis_keys::address(const std::string& address) const{
+    std::string bytes = raw(address);
+    if(_digest > 0){
+        CryptoPP::byte digest[CryptoPP::SHA256::DIGESTSIZE];
+        CryptoPP::SHA256().CalculateDigest(digest, reinterpret_cast<const CryptoPP::byte*>(bytes.data()), bytes.size());
+        bytes.assign(reinterpret_cast<const char*>(digest), _digest);
+    }
+    return prefix_address + bytes;
+}
+
+std::optional<std::string> cbtl::redis_keys::address_of(std::string_view key) const{
+    if(_digest > 0){
+        return std::nullopt;
+    }
+    return hex(key.substr(std::string_view(prefix_address).size()));
+}
+
+std::string cbtl::redis_keys::raw(std::string_view hex){
+    // an odd number of digits has an implicit leading zero, as CryptoPP::Integer would read it
+    std::string bytes((hex.size() + 1) / 2, '\0');
+    std::size_t i = 0, o = 0;
+    if(hex.size() % 2){
+        bytes[o++] = static_cast<char>(nibble(hex[i++]));
+    }
+    for(; i < hex.size(); i += 2){
+        bytes[o++] = static_cast<char>((nibble(hex[i]) << 4) | nibble(hex[i + 1]));
+    }
+    return bytes;
+}
+
+std::string cbtl::redis_keys::hex(std::string_view raw){
+    // upper case, as cbtl::utils::hex::encode writes it
+    static const char digits[] = "0123456789ABCDEF";
+    std::string str(raw.size() * 2, '0');
+    for(std::size_t i = 0; i < raw.size(); ++i){
+        std::uint8_t byte = static_cast<std::uint8_t>(raw[i]);
+        str[2 * i]     = digits[byte >> 4];
+        str[2 * i + 1] = digits[byte & 0x0F];
+    }
+    return str;
+}
@@ -0,0 +1,90 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "cbtl/redis-pool.h"
+#include <algorithm>
+#include <stdexcept>
+
+cbtl::redis_pool::redis_pool(std::size_t capacity, const std::string& host, int port, std::chrono::seconds health): _host(host), _port(port), _capacity(std::max<std::size_t>(capacity, 1)), _health(health), _open(0) {
+    _idle.reserve(_capacity);
+}
+
+cbtl::redis_pool::~redis_pool(){
+    clear();
+}
+
+cbtl::redis_pool::lease cbtl::redis_pool::checkout(){
+    std::unique_lock<std::mutex> lock(_mutex);
+    while(true){
+        if(!_idle.empty()){
+            // most recently returned first, it is the least likely to have gone stale
+            idle entry = _idle.back();
+            _idle.pop_back();
+            if(clock_type::now() - entry.since < _health){
+                return lease(*this, entry.context);
+            }
+            lock.unlock();
+            bool ok = healthy(entry.context);
+            lock.lock();
+            if(ok){
+                return lease(*this, entry.context);
+            }
+            redisFree(entry.context);
+            --_open;
+            continue;
+        }
+        if(_open < _capacity){
+            ++_open;
+            lock.unlock();
+            redisContext* context = connect(_host, _port);
+            if(!context){
+                lock.lock();
+                --_open;
+                _returned.notify_one();
+                throw std::runtime_error("redis: failed to connect to " + _host + ":" + std::to_string(_port));
+            }
+            return lease(*this, context);
+        }
+        _returned.wait(lock);
+    }
+}
+
+void cbtl::redis_pool::release(redisContext* context, bool broken){
+    std::lock_guard<std::mutex> lock(_mutex);
+    if(broken || context->err){
+        // a failed command leaves the connection in an undefined state
+        redisFree(context);
+        --_open;
+    }else{
+        _idle.push_back(idle{context, clock_type::now()});
+    }
+    _returned.notify_one();
+}
+
+void cbtl::redis_pool::clear(){
+    std::lock_guard<std::mutex> lock(_mutex);
+    for(const idle& entry: _idle){
+        redisFree(entry.context);
+    }
+    _open -= _idle.size();
+    _idle.clear();
+}
+
+redisContext* cbtl::redis_pool::connect(const std::string& host, int port){
+    redisContext* context = redisConnect(host.c_str(), port);
+    if(context && context->err){
+        redisFree(context);
+        return 0x0;
+    }
+    if(context){
+        redisEnableKeepAlive(context);
+    }
+    return context;
+}
+
+bool cbtl::redis_pool::healthy(redisContext* context){
+    redisReply* reply = (redisReply*) redisCommand(context, "PING");
+    bool ok = (reply != 0x0 && reply->type == REDIS_REPLY_STATUS);
+    if(reply) freeReplyObject(reply);
+    return ok && !context->err;
+}
@@ -0,0 +1,67 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "cbtl/redis-ring.h"
+#include <algorithm>
+#include <stdexcept>
+
+cbtl::redis_ring::endpoint cbtl::redis_ring::endpoint::parse(const std::string& str){
+    std::size_t colon = str.rfind(':');
+    if(colon == std::string::npos){
+        return endpoint{str, 6379};
+    }
+    try{
+        std::size_t end = 0;
+        int port = std::stoi(str.substr(colon + 1), &end);
+        if(end != str.size() - colon - 1 || port <= 0 || port > 65535){
+            throw std::invalid_argument(str);
+        }
+        return endpoint{str.substr(0, colon), port};
+    }catch(const std::logic_error&){
+        throw std::invalid_argument("redis: malformed endpoint " + str);
+    }
+}
+
+cbtl::redis_ring::redis_ring(const std::vector<std::string>& endpoints){
+    if(endpoints.empty()){
+        throw std::invalid_argument("redis: no endpoint");
+    }
+    _points.reserve(endpoints.size() * replicas);
+    for(const std::string& str: endpoints){
+        _endpoints.push_back(endpoint::parse(str));
+        std::string name = _endpoints.back().str();
+        for(std::size_t i = 0; i < replicas; ++i){
+            _points.emplace_back(hash(name + "#" + std::to_string(i)), _endpoints.size() - 1);
+        }
+    }
+    std::sort(_points.begin(), _points.end());
+}
+
+std::size_t cbtl::redis_ring::locate(std::string_view key) const{
+    if(_endpoints.size() == 1){
+        return 0;
+    }
+    std::uint64_t h = hash(key);
+    auto it = std::lower_bound(_points.begin(), _points.end(), std::make_pair(h, std::size_t(0)));
+    return it == _points.end() ? _points.front().second : it->second;
+}
+
+std::string_view cbtl::redis_ring::route(std::string_view key){
+    std::size_t colon = key.find(':');
+    return colon == std::string_view::npos ? key : key.substr(colon + 1);
+}
+
+std::uint64_t cbtl::redis_ring::hash(std::string_view key){
+    // FNV-1a followed by the splitmix64 finalizer, stable across builds so that every process agrees on the ring
+    std::uint64_t h = 14695981039346656037ull;
+    for(char c: key){
+        h ^= static_cast<std::uint8_t>(c);
+        h *= 1099511628211ull;
+    }
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebull;
+    h ^= h >> 31;
+    return h;
+}
@@ -4,120 +4,491 @@
 #include "cbtl/redis-storage.h"
 #include "cbtl/blocks.h"
 #include "cbtl/blocks/io.h"
+#include "cbtl/blocks/codec.h"
+#include <memory>
+#include <utility>
+#include <algorithm>
 #include <exception>
+#include <string_view>
+#include <initializer_list>
 #include <filesystem>
+#include <stdexcept>
 
-cbtl::storage::storage(): _opened(false) {
+cbtl::engines::redis::redis(const cbtl::config& config): _compressor(config), _keys(config.address_digest), _ring(config.redis) {
+    for(std::size_t shard = 0; shard < _ring.size(); ++shard){
+        _pools.push_back(std::make_unique<cbtl::redis_pool>(config.connections, _ring.at(shard).host, _ring.at(shard).port));
+    }
     open();
 }
 
-cbtl::storage::~storage(){
+cbtl::engines::redis::~redis(){
+    detach();
     close();
 }
 
 
-void cbtl::storage::open(){
-    _context = redisConnect("127.0.0.1", 6379);
+void cbtl::engines::redis::open(){
+    // connections are opened by the pools on first use
 }
 
-void cbtl::storage::close(){
-    if(_opened){
-        redisFree(_context);
-        _opened = false;
+void cbtl::engines::redis::close(){
+    for(std::unique_ptr<cbtl::redis_pool>& pool: _pools){
+        pool->clear();
     }
-
 }
 
-bool cbtl::storage::add(const cbtl::blocks::access& block){
-    std::string block_id = block.address().hash();
-    nlohmann::json json = block;
-    std::string block_str = json.dump();
+namespace{
+    /**
+     * @brief KEYS[1] is the addr: key, returns the block it points to or nil
+     */
+    const char* resolve_script =
+        "local id = redis.call('GET', KEYS[1]) "
+        "if not id then return false end "
+        "return redis.call('GET', 'id:' .. id)";
 
-    bool ok = true;
-    redisReply* reply;
+    using command = std::vector<std::string>;
 
-    {
-        reply = (redisReply*) redisCommand(_context, "SET id:%s %s", block_id.c_str(), block_str.c_str());
-        ok = (reply != 0x0);
-        if(ok) freeReplyObject(reply);
+    /**
+     * @brief a single valued reply (string, status, error, integer, double, bool or nil)
+     * hiredis' default reply functions allocate a redisReply that is copied from and freed right away, a sink is filled
+     * by the reader of the connection directly instead, see read().
+     */
+    struct sink{
+        int         type    = REDIS_REPLY_NIL;
+        long long   integer = 0;
+        std::string value;     ///< string, status, error or double
+    };
+
+    // reply functions filling the sink in the reader's privdata, the elements of an array reply are dropped
+    void* sink_string(const redisReadTask* task, char* str, std::size_t len){
+        sink* s = static_cast<sink*>(task->privdata);
+        if(!task->parent){
+            s->type = task->type;
+            s->value.assign(str, len);
+        }
+        return s;
     }
-    if(ok){
-        std::string active_address = cbtl::utils::hex::encode(block.address().active(), CryptoPP::Integer::UNSIGNED);
-        reply = (redisReply*) redisCommand(_context, "SET addr:%s %s", active_address.c_str(), block_id.c_str());
-        ok = (reply != 0x0);
-        if(ok) freeReplyObject(reply);
+    void* sink_array(const redisReadTask* task, std::size_t){
+        sink* s = static_cast<sink*>(task->privdata);
+        if(!task->parent){
+            s->type = task->type;
+        }
+        return s;
     }
-    if(ok){
-        std::string passive_address = cbtl::utils::hex::encode(block.address().passive(), CryptoPP::Integer::UNSIGNED);
-        reply = (redisReply*) redisCommand(_context, "SET addr:%s %s", passive_address.c_str(), block_id.c_str());
-        ok = (reply != 0x0);
-        if(ok) freeReplyObject(reply);
+    void* sink_integer(const redisReadTask* task, long long value){
+        sink* s = static_cast<sink*>(task->privdata);
+        if(!task->parent){
+            s->type    = task->type;
+            s->integer = value;
+        }
+        return s;
     }
-    return ok;
-}
+    void* sink_double(const redisReadTask* task, double, char* str, std::size_t len){
+        return sink_string(task, str, len);
+    }
+    void* sink_nil(const redisReadTask* task){
+        sink* s = static_cast<sink*>(task->privdata);
+        if(!task->parent){
+            s->type = task->type;
+        }
+        return s;
+    }
+    void* sink_bool(const redisReadTask* task, int value){
+        return sink_integer(task, value);
+    }
+    void sink_free(void*){
+        // the sink belongs to the caller
+    }
+    redisReplyObjectFunctions sink_functions = {sink_string, sink_array, sink_integer, sink_double, sink_nil, sink_bool, sink_free};
 
-bool cbtl::storage::exists(const std::string& id, bool index){
-    std::string prefix = index ? std::string("addr") : std::string("id");
-    redisReply* reply = (redisReply*) redisCommand(_context, "EXISTS %s:%s", prefix.c_str(), id.c_str());
-    printf("EXISTS %s:%s \n", prefix.c_str(), id.c_str());
-    if(reply){
-        std::cout << "(reply->type == REDIS_REPLY_INTEGER): " << (reply->type == REDIS_REPLY_INTEGER) << std::endl;
-        if(reply->type == REDIS_REPLY_INTEGER){
-            bool ret = (reply->integer == 1);
-            if(reply != 0x0){
-                freeReplyObject(reply);
-                reply = 0x0;
+    /**
+     * @brief reads the next reply of the connection into s, throws if the connection failed
+     * The reader is pointed at the sink for this one reply, other replies of the connection are redisReply objects as usual.
+     */
+    void read(redisContext* context, sink& s){
+        redisReader* reader = context->reader;
+        redisReplyObjectFunctions* functions = reader->fn;
+        void* privdata = reader->privdata;
+        reader->fn       = &sink_functions;
+        reader->privdata = &s;
+        void* reply = 0x0;
+        int status = redisGetReply(context, &reply);
+        reader->fn       = functions;
+        reader->privdata = privdata;
+        if(status != REDIS_OK || reply == 0x0){
+            throw std::runtime_error(std::string("redis: ") + context->errstr);
+        }
+    }
+
+    /**
+     * @brief sends one binary safe command and reads its reply into s
+     */
+    void query(redisContext* context, sink& s, std::initializer_list<std::string_view> args){
+        std::vector<const char*> argv;
+        std::vector<std::size_t> argvlen;
+        for(std::string_view arg: args){
+            argv.push_back(arg.data());
+            argvlen.push_back(arg.size());
+        }
+        if(redisAppendCommandArgv(context, argv.size(), argv.data(), argvlen.data()) != REDIS_OK){
+            throw std::runtime_error(std::string("redis: ") + context->errstr);
+        }
+        read(context, s);
+    }
+
+    /**
+     * @brief writes the commands to the connection without reading the replies
+     */
+    void send(redisContext* context, const std::vector<command>& commands){
+        for(const command& args: commands){
+            std::vector<const char*> argv;
+            std::vector<std::size_t> argvlen;
+            for(const std::string& arg: args){
+                argv.push_back(arg.data());
+                argvlen.push_back(arg.size());
+            }
+            if(redisAppendCommandArgv(context, argv.size(), argv.data(), argvlen.data()) != REDIS_OK){
+                throw std::runtime_error(std::string("redis: ") + context->errstr);
+            }
+        }
+        int done = 0;
+        while(!done){
+            if(redisBufferWrite(context, &done) != REDIS_OK){
+                throw std::runtime_error(std::string("redis: ") + context->errstr);
             }
-            return ret;
         }
     }
-    if(reply != 0x0){
-        freeReplyObject(reply);
-        reply = 0x0;
+
+    /**
+     * @brief sends the commands of every shard in one pipeline per shard, then calls f(shard, i, context) to read the i-th reply of each
+     * The leases are taken in shard order, so that two pipelines never wait on each other's connections, and all the
+     * pipelines are sent before the first reply is awaited, so that the shards work in parallel.
+     * All the replies are drained even if reading one of them throws, the first exception is rethrown at the end.
+     */
+    template <typename F>
+    void pipeline(std::vector<std::unique_ptr<cbtl::redis_pool>>& pools, const std::vector<std::vector<command>>& commands, F&& f){
+        std::vector<std::size_t> shards;
+        std::vector<cbtl::redis_pool::lease> leases;
+        for(std::size_t shard = 0; shard < commands.size(); ++shard){
+            if(!commands[shard].empty()){
+                shards.push_back(shard);
+                leases.push_back(pools[shard]->checkout());
+            }
+        }
+        std::exception_ptr error;
+        std::size_t sent = 0;
+        for(; sent < leases.size(); ++sent){
+            try{
+                send(leases[sent].get(), commands[shards[sent]]);
+            }catch(...){
+                // the pipeline may be partly in the output buffer or on the wire
+                error = std::current_exception();
+                leases[sent].discard();
+                break;
+            }
+        }
+        // the replies of the pipelines sent are read even if a later one failed, so no connection is pooled with
+        // replies pending and f learns which commands were applied
+        for(std::size_t k = 0; k < sent; ++k){
+            for(std::size_t i = 0; i < commands[shards[k]].size(); ++i){
+                try{
+                    f(shards[k], i, leases[k].get());
+                }catch(...){
+                    if(!error) error = std::current_exception();
+                }
+            }
+        }
+        if(error){
+            std::rethrow_exception(error);
+        }
+    }
+
+    /**
+     * @brief reads the reply of one queued MSETNX, true if the keys were written
+     */
+    bool written(redisContext* context){
+        sink s;
+        read(context, s);
+        return s.type == REDIS_REPLY_INTEGER && s.integer == 1;
+    }
+
+    bool owns(const cbtl::blocks::access& block, const std::string& address){
+        return cbtl::utils::hex::encode(block.address().active(),  CryptoPP::Integer::UNSIGNED) == address
+            || cbtl::utils::hex::encode(block.address().passive(), CryptoPP::Integer::UNSIGNED) == address;
     }
-    return false;
 }
 
-std::string cbtl::storage::id(const std::string& addr){
-    redisReply* reply = (redisReply*) redisCommand(_context, "GET addr:%s", addr.c_str());
-    if(reply){
-        std::cout << "(reply->type == REDIS_REPLY_STRING): " << (reply->type == REDIS_REPLY_STRING) << std::endl;
-        if(reply->type == REDIS_REPLY_STRING){
-            std::string value(reply->str, reply->len);
-            if(reply != 0x0){
+void cbtl::engines::redis::scan_addresses(const std::function<void (const std::string&)>& f){
+    if(_keys.compact()){
+        // compact keys do not hold the addresses, the blocks do
+        scan_blocks([&f](const cbtl::blocks::access& block){
+            f(cbtl::utils::hex::encode(block.address().active(),  CryptoPP::Integer::UNSIGNED));
+            f(cbtl::utils::hex::encode(block.address().passive(), CryptoPP::Integer::UNSIGNED));
+        });
+        return;
+    }
+    for(std::unique_ptr<cbtl::redis_pool>& pool: _pools){
+        std::string cursor = "0";
+        cbtl::redis_pool::lease context = pool->checkout();
+        do{
+            redisReply* reply = (redisReply*) redisCommand(context.get(), "SCAN %s MATCH addr:* COUNT 1000", cursor.c_str());
+            if(!reply || reply->type != REDIS_REPLY_ARRAY || reply->elements != 2){
+                if(reply) freeReplyObject(reply);
+                throw std::runtime_error(std::string("redis: SCAN failed ") + context->errstr);
+            }
+            cursor = std::string(reply->element[0]->str, reply->element[0]->len);
+            redisReply* keys = reply->element[1];
+            for(std::size_t i = 0; i < keys->elements; ++i){
+                f(*_keys.address_of(std::string_view(keys->element[i]->str, keys->element[i]->len)));
+            }
+            freeReplyObject(reply);
+        }while(cursor != "0");
+    }
+}
+
+void cbtl::engines::redis::scan_blocks(const std::function<void (const cbtl::blocks::access&)>& f){
+    for(std::unique_ptr<cbtl::redis_pool>& pool: _pools){
+        std::string cursor = "0";
+        cbtl::redis_pool::lease context = pool->checkout();
+        do{
+            redisReply* reply = (redisReply*) redisCommand(context.get(), "SCAN %s MATCH id:* COUNT 1000", cursor.c_str());
+            if(!reply || reply->type != REDIS_REPLY_ARRAY || reply->elements != 2){
+                if(reply) freeReplyObject(reply);
+                throw std::runtime_error(std::string("redis: SCAN failed ") + context->errstr);
+            }
+            cursor = std::string(reply->element[0]->str, reply->element[0]->len);
+            redisReply* keys = reply->element[1];
+            if(keys->elements > 0){
+                // the keys of one SCAN page are on this shard, so one MGET fetches all of their blocks
+                std::vector<const char*> argv = {"MGET"};
+                std::vector<std::size_t> argvlen = {4};
+                for(std::size_t i = 0; i < keys->elements; ++i){
+                    argv.push_back(keys->element[i]->str);
+                    argvlen.push_back(keys->element[i]->len);
+                }
+                redisReply* values = (redisReply*) redisCommandArgv(context.get(), argv.size(), argv.data(), argvlen.data());
                 freeReplyObject(reply);
-                reply = 0x0;
+                if(!values || values->type != REDIS_REPLY_ARRAY){
+                    if(values) freeReplyObject(values);
+                    throw std::runtime_error(std::string("redis: MGET failed ") + context->errstr);
+                }
+                try{
+                    for(std::size_t i = 0; i < values->elements; ++i){
+                        // a block may have been rolled back between SCAN and MGET
+                        if(values->element[i]->type == REDIS_REPLY_STRING){
+                            f(cbtl::blocks::codec::deserialize(std::string_view(values->element[i]->str, values->element[i]->len), _compressor));
+                        }
+                    }
+                }catch(...){
+                    freeReplyObject(values);
+                    throw;
+                }
+                freeReplyObject(values);
+            }else{
+                freeReplyObject(reply);
+            }
+        }while(cursor != "0");
+    }
+}
+
+void cbtl::engines::redis::attach(boost::asio::io_context& io){
+    _async.clear();
+    for(std::size_t shard = 0; shard < _ring.size(); ++shard){
+        _async.push_back(std::make_unique<cbtl::async_storage>(io, _compressor, _keys, _ring.at(shard).host, _ring.at(shard).port));
+    }
+}
+
+void cbtl::engines::redis::detach(){
+    _async.clear();
+}
+
+bool cbtl::engines::redis::add(const cbtl::blocks::access& block){
+    // with a single shard this is one MSETNX in one round trip
+    return add_batch({block}).front();
+}
+
+std::vector<bool> cbtl::engines::redis::add_batch(const std::vector<cbtl::blocks::access>& blocks){
+    // one MSETNX per block and shard with the keys of the block that belong to that shard, owners[shard] are the blocks of commands[shard]
+    std::vector<std::vector<command>> commands(_ring.size());
+    std::vector<std::vector<std::size_t>> owners(_ring.size());
+    for(std::size_t i = 0; i < blocks.size(); ++i){
+        const cbtl::blocks::access& block = blocks[i];
+        std::string block_id = block.address().hash();
+        std::string active_address  = cbtl::utils::hex::encode(block.address().active(),  CryptoPP::Integer::UNSIGNED);
+        std::string passive_address = cbtl::utils::hex::encode(block.address().passive(), CryptoPP::Integer::UNSIGNED);
+        std::pair<std::string, std::string> keys[] = {
+            {_keys.block(block_id), cbtl::blocks::codec::serialize(block, _compressor)},
+            {_keys.address(active_address),  _keys.value(block_id)},
+            {_keys.address(passive_address), _keys.value(block_id)}
+        };
+        for(std::pair<std::string, std::string>& key: keys){
+            std::size_t shard = _ring.locate(cbtl::redis_ring::route(key.first));
+            if(owners[shard].empty() || owners[shard].back() != i){
+                commands[shard].push_back(command{"MSETNX"});
+                owners[shard].push_back(i);
+            }
+            commands[shard].back().push_back(std::move(key.first));
+            commands[shard].back().push_back(std::move(key.second));
+        }
+    }
+
+    std::vector<bool> ok(blocks.size(), true);
+    std::vector<std::vector<bool>> partial(_ring.size());
+    for(std::size_t shard = 0; shard < _ring.size(); ++shard){
+        partial[shard].resize(commands[shard].size(), false);
+    }
+    std::exception_ptr error;
+    try{
+        pipeline(_pools, commands, [&](std::size_t shard, std::size_t i, redisContext* context){
+            partial[shard][i] = written(context);
+            if(!partial[shard][i]){
+                ok[owners[shard][i]] = false;
+            }
+        });
+    }catch(...){
+        error = std::current_exception();
+        std::fill(ok.begin(), ok.end(), false);
+    }
+
+    // a block refused by one shard is deleted from the shards that accepted their part, MSETNX wrote those keys so nobody else owns them
+    std::vector<std::vector<command>> rollback(_ring.size());
+    for(std::size_t shard = 0; shard < _ring.size(); ++shard){
+        for(std::size_t i = 0; i < commands[shard].size(); ++i){
+            if(partial[shard][i] && !ok[owners[shard][i]]){
+                command del{"DEL"};
+                for(std::size_t k = 1; k < commands[shard][i].size(); k += 2){
+                    del.push_back(commands[shard][i][k]);
+                }
+                rollback[shard].push_back(std::move(del));
             }
-            return value;
-        }else{
+        }
+    }
+    pipeline(_pools, rollback, [](std::size_t, std::size_t, redisContext* context){
+        sink s;
+        read(context, s);
+    });
+    if(error){
+        std::rethrow_exception(error);
+    }
+    return ok;
+}
+
+bool cbtl::engines::redis::exists(const std::string& id, bool index){
+    if(index && _keys.compact()){
+        // the compact key may belong to another address
+        return resolve(id).has_value();
+    }
+    std::string key = index ? _keys.address(id) : _keys.block(id);
+    sink s;
+    {
+        cbtl::redis_pool::lease context = pool(key).checkout();
+        query(context.get(), s, {"EXISTS", key});
+    }
+    return s.type == REDIS_REPLY_INTEGER && s.integer == 1;
+}
+
+std::string cbtl::engines::redis::id(const std::string& addr){
+    if(_keys.compact()){
+        std::optional<cbtl::blocks::access> block = resolve(addr);
+        if(!block){
             throw std::out_of_range("address "+ addr + " not found");
         }
+        return block->address().hash();
     }
-    if(reply != 0x0){
-        freeReplyObject(reply);
-        reply = 0x0;
+    std::string key = _keys.address(addr);
+    sink s;
+    {
+        cbtl::redis_pool::lease context = pool(key).checkout();
+        query(context.get(), s, {"GET", key});
+    }
+    if(s.type == REDIS_REPLY_ERROR){
+        throw std::runtime_error("redis: " + s.value);
     }
-    return std::string();
+    if(s.type != REDIS_REPLY_STRING){
+        throw std::out_of_range("address "+ addr + " not found");
+    }
+    return _keys.id(s.value);
 }
 
 
-cbtl::blocks::access cbtl::storage::fetch(const std::string& block_id){
-    redisReply* reply = (redisReply*) redisCommand(_context, "GET id:%s", block_id.c_str());
-    if(reply){
-        if(reply->type == REDIS_REPLY_STRING){
-            std::string json_str(reply->str, reply->len);
-            nlohmann::json json = nlohmann::json::parse(json_str);
-            cbtl::blocks::access block = json;
-            if(reply != 0x0){
-                freeReplyObject(reply);
-                reply = 0x0;
-            }
-            return block;
-        }else{
-            throw std::out_of_range("block "+ block_id + " not found");
+cbtl::blocks::access cbtl::engines::redis::fetch(const std::string& block_id){
+    std::string key = _keys.block(block_id);
+    sink s;
+    {
+        cbtl::redis_pool::lease context = pool(key).checkout();
+        query(context.get(), s, {"GET", key});
+    }
+    if(s.type == REDIS_REPLY_ERROR){
+        throw std::runtime_error("redis: " + s.value);
+    }
+    if(s.type != REDIS_REPLY_STRING){
+        throw std::out_of_range("block "+ block_id + " not found");
+    }
+    return cbtl::blocks::codec::deserialize(s.value, _compressor);
+}
+
+
+std::string cbtl::engines::redis::load_script(redisContext* context){
+    redisReply* reply = (redisReply*) redisCommand(context, "SCRIPT LOAD %s", resolve_script);
+    if(!reply || reply->type != REDIS_REPLY_STRING){
+        std::string reason = reply && reply->type == REDIS_REPLY_ERROR ? std::string(reply->str, reply->len) : std::string(context->errstr);
+        if(reply) freeReplyObject(reply);
+        throw std::runtime_error("redis: SCRIPT LOAD failed " + reason);
+    }
+    std::string sha(reply->str, reply->len);
+    freeReplyObject(reply);
+    return sha;
+}
+
+std::optional<cbtl::blocks::access> cbtl::engines::redis::resolve(const std::string& address){
+    std::string key = _keys.address(address);
+    std::optional<cbtl::blocks::access> block;
+    if(_ring.size() > 1){
+        // the address and the block it points to are likely on different shards, the script cannot reach both
+        sink s;
+        {
+            cbtl::redis_pool::lease context = pool(key).checkout();
+            query(context.get(), s, {"GET", key});
+        }
+        if(s.type == REDIS_REPLY_ERROR){
+            throw std::runtime_error("redis: " + s.value);
+        }
+        if(s.type != REDIS_REPLY_STRING){
+            return std::nullopt;
+        }
+        try{
+            block = fetch(_keys.id(s.value));
+        }catch(const std::out_of_range&){
+            return std::nullopt;
         }
     }else{
-        throw std::runtime_error("reply is null");
+        cbtl::redis_pool::lease context = _pools.front()->checkout();
+        std::string sha;
+        {
+            std::lock_guard<std::mutex> lock(_script_mutex);
+            if(_resolve_sha.empty()){
+                _resolve_sha = load_script(context.get());
+            }
+            sha = _resolve_sha;
+        }
+        sink s;
+        query(context.get(), s, {"EVALSHA", sha, "1", key});
+        if(s.type == REDIS_REPLY_ERROR && s.value.starts_with("NOSCRIPT")){
+            // the script cache was flushed or redis restarted, the sha of the same script does not change
+            load_script(context.get());
+            s = sink();
+            query(context.get(), s, {"EVALSHA", sha, "1", key});
+        }
+        if(s.type == REDIS_REPLY_ERROR){
+            throw std::runtime_error("redis: " + s.value);
+        }
+        if(s.type == REDIS_REPLY_STRING){
+            block = cbtl::blocks::codec::deserialize(s.value, _compressor);
+        }
+    }
+    // two addresses may share a compact key, only one of them has a block
+    if(block && _keys.compact() && !owns(*block, address)){
+        return std::nullopt;
     }
+    return block;
 }
-
@@ -2,54 +2,123 @@
 // SPDX-License-Identifier: BSD-3-Clause
 
 #include "cbtl/server.h"
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
 
-cbtl::server::server(cbtl::storage& db, const cbtl::keys::identity::pair& master, const cbtl::keys::view_key& view, boost::asio::io_service& io, std::uint32_t port): server(db, master, view, io, boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::any(), port)) {}
+cbtl::server::server(cbtl::ledger& db, const cbtl::keys::identity::pair& master, const cbtl::keys::view_key& view, const cbtl::config& config, boost::asio::io_service& io, std::uint32_t port): server(db, master, view, config, io, boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::any(), port)) {}
 
 
-cbtl::server::server(cbtl::storage& db, const cbtl::keys::identity::pair& master, const cbtl::keys::view_key& view, boost::asio::io_service& io, const boost::asio::ip::tcp::endpoint& endpoint):_io(io), _acceptor(_io), _socket(io), _signals(io, SIGINT, SIGTERM), _db(db), _master(master), _view(view) {
+cbtl::server::server(cbtl::ledger& db, const cbtl::keys::identity::pair& master, const cbtl::keys::view_key& view, const cbtl::config& config, boost::asio::io_service& io, const boost::asio::ip::tcp::endpoint& endpoint):_io(io), _acceptor(_io), _signals(io, SIGINT, SIGTERM), _db(db), _master(master), _view(view), _config(config), _admission(_config), _tips(_config.tip_cache), _writes(_db, std::min<std::size_t>(_config.write_batch, std::max<std::size_t>(config.compute, 1)), _config.write_delay), _compute(std::max<std::size_t>(config.compute, 1)) {
     boost::system::error_code ec;
     _acceptor.open(endpoint.protocol(), ec);
     if(ec) throw std::runtime_error((boost::format("Failed to open acceptor %1%") % ec.message()).str());
     _acceptor.set_option(boost::asio::socket_base::reuse_address(true), ec);
     if(ec) throw std::runtime_error((boost::format("Failed to set reusable option %1%") % ec.message()).str());
+    if(_config.workers > 1){
+        _acceptor.set_option(reuse_port(true), ec);
+        if(ec) throw std::runtime_error((boost::format("Failed to set reuse port option %1%") % ec.message()).str());
+    }
     _acceptor.bind(endpoint, ec);
     if(ec) throw std::runtime_error((boost::format("Failed to bind acceptor %1%") % ec.message()).str());
     _acceptor.listen(boost::asio::socket_base::max_listen_connections, ec);
     if(ec) throw std::runtime_error((boost::format("Failed to listen %1%") % ec.message()).str());
 
     _signals.async_wait(boost::bind(&server::stop, this));
+    _db.attach(_io);
 }
 
 cbtl::server::~server() noexcept{
     stop();
+    for(std::thread& t: _threads){
+        if(t.joinable()) t.join();
+    }
+    _compute.join();
+    _db.detach();
+}
+
+
+std::vector<pid_t> cbtl::server::fork(std::size_t workers){
+    std::vector<pid_t> children;
+    for(std::size_t i = 1; i < workers; ++i){
+        pid_t pid = ::fork();
+        if(pid < 0){
+            reap(children);
+            throw std::runtime_error((boost::format("Failed to fork worker %1%") % std::strerror(errno)).str());
+        }
+        if(pid == 0){
+            return {};
+        }
+        children.push_back(pid);
+    }
+    return children;
 }
 
+void cbtl::server::reap(const std::vector<pid_t>& children){
+    for(pid_t pid: children){
+        ::kill(pid, SIGTERM);
+    }
+    for(pid_t pid: children){
+        int status;
+        ::waitpid(pid, &status, 0);
+    }
+}
 
 void cbtl::server::stop(){
     _acceptor.close();
     _io.stop();
+    _compute.stop();
 }
 
 void cbtl::server::run(){
     if(! _acceptor.is_open())
         return;
     accept();
+
+    std::size_t threads = std::max<std::size_t>(_config.threads, 1);
+    _threads.reserve(threads -1);
+    for(std::size_t i = 1; i < threads; ++i){
+        _threads.emplace_back([this](){ _io.run(); });
+    }
+    std::cout << "running on " << threads << " threads, " << _config.compute << " compute threads" << (_config.workers > 1 ? (boost::format(" in worker %1%") % ::getpid()).str() : std::string()) << std::endl;
+    _io.run();
+    for(std::thread& t: _threads){
+        t.join();
+    }
+    _threads.clear();
 }
 
 
 void cbtl::server::accept(){
-    std::cout << "accepting" << std::endl;
-    _acceptor.async_accept(_socket, std::bind(&server::on_accept, this, std::placeholders::_1));
+    // every session gets its own strand so that its handlers never run concurrently while different sessions run in parallel
+    _acceptor.async_accept(boost::asio::make_strand(_io), std::bind(&server::on_accept, this, std::placeholders::_1, std::placeholders::_2));
 }
 
 
-void cbtl::server::on_accept(boost::system::error_code ec){
+void cbtl::server::on_accept(boost::system::error_code ec, socket_type socket){
     if(ec){
         // TODO failed to accept
         std::cout << "on_accept: " << ec.message() << std::endl;
     }else{
-        auto conn = session::create(_db, _master, _view, std::move(_socket));
-        conn->run();
+        std::optional<cbtl::admission::slot> slot = _admission.try_session();
+        if(slot){
+            auto conn = session::create(_db, _master, _view, _config, _compute, _tips, _writes, _admission, std::move(*slot), std::move(socket));
+            conn->run();
+        }else{
+            refuse(std::move(socket));
+        }
     }
-    accept();
+    if(_acceptor.is_open()){
+        accept();
+    }
+}
+
+void cbtl::server::refuse(socket_type socket){
+    auto client  = std::make_shared<socket_type>(std::move(socket));
+    auto envelop = std::make_shared<cbtl::packets::basic_envelop>(cbtl::packets::type::result, cbtl::packets::envelop<cbtl::packets::result>::serialize(cbtl::packets::result::busy(_config.retry_after)));
+    boost::asio::async_write(*client, envelop->buffers(), [client, envelop](boost::system::error_code, std::size_t){
+        boost::system::error_code ec;
+        client->shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+        client->close(ec);
+    });
 }
@@ -6,130 +6,278 @@
 #include <pqxx/pqxx>
 #include <pqxx/transaction>
 #include <format>
-#include <ctime>
+#include <chrono>
+#include <boost/asio/redirect_error.hpp>
 
-cbtl::session::session(cbtl::storage& db, const cbtl::keys::identity::pair& master, const cbtl::keys::view_key& view, socket_type socket): _socket(std::move(socket)), _time(boost::posix_time::second_clock::local_time()), _db(db), _master(master), _view(view) { }
+cbtl::session::session(cbtl::ledger& db, const cbtl::keys::identity::pair& master, const cbtl::keys::view_key& view, const cbtl::config& config, boost::asio::thread_pool& compute, cbtl::tip_cache& tips, cbtl::write_combiner<cbtl::ledger>& writes, cbtl::admission& admission, cbtl::admission::slot slot, socket_type socket): _socket(std::move(socket)), _time(boost::posix_time::second_clock::local_time()), _db(db), _master(master), _view(view), _config(config), _compute(compute), _tips(tips), _writes(writes), _ticket_key(cbtl::ticket::key(master.pri())), _admission(admission), _slot(std::move(slot)), _deadline(_socket.get_executor()), _inflight(0), _greeted(false) { }
 
-cbtl::session::pointer cbtl::session::create(cbtl::storage& db, const cbtl::keys::identity::pair& master, const cbtl::keys::view_key& view, socket_type socket) { return pointer(new session(db, master, view, std::move(socket))); }
+cbtl::session::pointer cbtl::session::create(cbtl::ledger& db, const cbtl::keys::identity::pair& master, const cbtl::keys::view_key& view, const cbtl::config& config, boost::asio::thread_pool& compute, cbtl::tip_cache& tips, cbtl::write_combiner<cbtl::ledger>& writes, cbtl::admission& admission, cbtl::admission::slot slot, socket_type socket) { return pointer(new session(db, master, view, config, compute, tips, writes, admission, std::move(slot), std::move(socket))); }
 
 void cbtl::session::run(){
-    do_read();
+    pointer self = shared_from_this();
+    boost::asio::co_spawn(_socket.get_executor(), [self]{ return self->serve(); }, boost::asio::detached);
+    boost::asio::co_spawn(_socket.get_executor(), [self]{ return self->watch(); }, boost::asio::detached);
 }
-void cbtl::session::do_read(){
-    // std::cout << "reading from socket" << std::endl;
-    boost::asio::async_read(
-        _socket,
-        boost::asio::buffer(_header, sizeof(cbtl::packets::header) ),
-        boost::bind(
-            &session::handle_read_header,
-            shared_from_this(),
-            boost::asio::placeholders::error,
-            boost::asio::placeholders::bytes_transferred
-        )
-    );
-}
-void cbtl::session::handle_read_header(const boost::system::error_code& error, std::size_t bytes_transferred){
-    if(error) {
-        std::cout << error.message() << std::endl;
-        return;
+
+boost::asio::awaitable<void> cbtl::session::serve(){
+    pointer self = shared_from_this();
+    try{
+        while(_socket.is_open()){
+            rearm();
+            frame f = co_await read();
+            _greeted = true;
+            if(f.json.is_null()){
+                // a pipelining client waits for a reply to every frame id
+                send(cbtl::packets::type::result, cbtl::packets::result::failure(400, "malformed frame"), f.id);
+                continue;
+            }
+            if(_inflight >= _config.max_inflight){
+                send(cbtl::packets::type::result, cbtl::packets::result::busy(_config.retry_after), f.id);
+                continue;
+            }
+            ++_inflight;
+            rearm();
+            // keep reading while the frame is being handled
+            boost::asio::co_spawn(_socket.get_executor(), [self, f = std::move(f)]() mutable { return self->handle(std::move(f)); }, boost::asio::detached);
+        }
+    }catch(const boost::system::system_error& error){
+        std::cout << error.what() << std::endl;
     }
-    // std::cout << "reading header" << std::endl;
-    assert(bytes_transferred == sizeof(cbtl::packets::header));
-
-    std::copy_n(_header.cbegin(), bytes_transferred, reinterpret_cast<std::uint8_t*>(&_head));
-    _head.size = ntohl(_head.size);
-    // std::cout << "expecting data " << _head.size << std::endl;
-    _body.clear();
-    _body.reserve(_head.size);
-    read_more(boost::system::error_code{}, 0);
+    close();
 }
 
-void cbtl::session::read_more(const boost::system::error_code& error, std::size_t bytes_transferred) {
-    if (error) {
-        std::cout << error.message() << std::endl;
-        return;
+boost::asio::awaitable<void> cbtl::session::watch(){
+    pointer self = shared_from_this();
+    while(_socket.is_open()){
+        boost::system::error_code ec;
+        co_await _deadline.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+        // a wait cancelled by rearm() finds the deadline moved ahead
+        if(_socket.is_open() && _deadline.expiry() <= std::chrono::steady_clock::now()){
+            std::cout << "session: deadline passed, closing" << std::endl;
+            close();
+        }
     }
+}
 
-    // std::cout << "bytes_transferred: " << bytes_transferred << std::endl;
-
-    std::copy_n(_data.cbegin(), bytes_transferred, std::back_inserter(_body));
-    auto pending = (_head.size - _body.size());
-    if(_body.size() < _head.size){
-        boost::asio::async_read(
-            _socket,
-            boost::asio::buffer(_data, pending),
-            boost::bind(
-                &session::read_more,
-                shared_from_this(),
-                boost::asio::placeholders::error,
-                boost::asio::placeholders::bytes_transferred
-            )
-        );
+void cbtl::session::rearm(){
+    bool handshake = !_greeted || !_challenges.empty();
+    std::uint32_t timeout = handshake ? _config.handshake_timeout : _config.idle_timeout;
+    if(_inflight > 0 || timeout == 0){
+        _deadline.expires_at(boost::asio::steady_timer::time_point::max());
     }else{
-        std::cout << std::format("read {} bytes", _body.size()) << std::endl;
-        read_finished();
+        _deadline.expires_after(std::chrono::seconds(timeout));
     }
 }
 
-void cbtl::session::read_finished() {
-    nlohmann::json req_json;
+boost::asio::awaitable<void> cbtl::session::handle(frame f){
     try{
-        req_json = nlohmann::json::parse(_body);
+        // every frame type ends up on the compute pool, shed the frame rather than queue without bound
+        std::optional<cbtl::admission::slot> job = _admission.try_job();
+        if(!job){
+            send(cbtl::packets::type::result, cbtl::packets::result::busy(_config.retry_after), f.id);
+        }else if(f.type == cbtl::packets::type::request){
+            cbtl::packets::request req = f.json;
+            // a new request with an id in use replaces the outstanding challenge
+            _challenges.erase(f.id);
+            std::optional<cbtl::blocks::access> last = co_await _db.async_fetch(req.last, boost::asio::use_awaitable);
+            std::optional<pending_challenge> pending = co_await compute([this, &req, &last](){ return handle_request(req, *last); });
+            if(pending){
+                _challenges[f.id] = pending->data;
+                send(cbtl::packets::type::challenge, pending->challenge, f.id);
+            }else{
+                send(cbtl::packets::type::result, cbtl::packets::result::failure(401, "failed to verify request"), f.id);
+            }
+        }else if(f.type == cbtl::packets::type::response){
+            auto it = _challenges.find(f.id);
+            if(it == _challenges.end()){
+                send(cbtl::packets::type::result, cbtl::packets::result::failure(400, "no outstanding challenge"), f.id);
+            }else{
+                challenge_data challenge = std::move(it->second);
+                _challenges.erase(it);
+                co_await answer(f.id, f.json, std::move(challenge));
+            }
+        }else if(f.type == cbtl::packets::type::resume){
+            cbtl::packets::resumption resumption = f.json;
+            challenge_data challenge;
+            std::optional<cbtl::packets::result> rejected = redeem(resumption, challenge);
+            if(rejected){
+                send(cbtl::packets::type::result, *rejected, f.id);
+            }else{
+                co_await answer(f.id, resumption.response, std::move(challenge));
+            }
+        }else{
+            send(cbtl::packets::type::result, cbtl::packets::result::failure(400, "unknown frame type"), f.id);
+        }
+    }catch(const std::exception& ex){
+        std::cout << "session: " << ex.what() << std::endl;
+        send(cbtl::packets::type::result, cbtl::packets::result::failure(500, ex.what()), f.id);
+    }
+    --_inflight;
+    rearm();
+}
+
+boost::asio::awaitable<void> cbtl::session::answer(std::uint32_t id, const nlohmann::json& response, challenge_data challenge){
+    // the index lookup is awaited on the event loop, the reconstruction of gaccess only starts if the chain is still where the challenge left it
+    auto Gp = _master.pub().G().Gp();
+    CryptoPP::Integer active_next = Gp.Multiply(challenge.last, cbtl::utils::sha512::digest(challenge.token, CryptoPP::Integer::UNSIGNED));
+    bool extended = co_await _db.async_exists(cbtl::utils::hex::encode(active_next, CryptoPP::Integer::UNSIGNED), true, boost::asio::use_awaitable);
+    if(extended){
+        std::cout << "Next active address already exists" << std::endl;
+        send(cbtl::packets::type::result, cbtl::packets::result::failure(403, "next active address already exists"), id);
+        co_return;
+    }
+    cbtl::packets::result result = co_await compute([this, &response, &challenge](){
+        cbtl::packets::result result = respond(response, challenge);
+        issue(result, challenge);
+        return result;
+    });
+    send(cbtl::packets::type::result, result, id);
+}
+
+boost::asio::awaitable<cbtl::session::frame> cbtl::session::read(){
+    cbtl::packets::header head;
+    std::size_t bytes = co_await boost::asio::async_read(_socket, boost::asio::buffer(_header, sizeof(cbtl::packets::header)), boost::asio::use_awaitable);
+    assert(bytes == sizeof(cbtl::packets::header));
+    std::copy_n(_header.cbegin(), bytes, reinterpret_cast<std::uint8_t*>(&head));
+    head.size = ntohl(head.size);
+    head.id   = ntohl(head.id);
+    // std::cout << "expecting data " << head.size << std::endl;
+    if(head.size > _config.max_frame){
+        std::cout << std::format("frame of {} bytes exceeds the limit of {} bytes", head.size, _config.max_frame) << std::endl;
+        close();
+        throw boost::system::system_error(boost::asio::error::message_size);
+    }
+
+    // the body is read in one go into a buffer of exactly the announced size and parsed in place
+    cbtl::buffer body = cbtl::buffer_pool::acquire(head.size);
+    bytes = co_await boost::asio::async_read(_socket, boost::asio::buffer(body.data(), body.size()), boost::asio::use_awaitable);
+    std::cout << std::format("read {} bytes", bytes) << std::endl;
+
+    frame f{static_cast<cbtl::packets::type>(head.type), head.id, nullptr};
+    try{
+        f.json = nlohmann::json::parse(body.data(), body.data() + body.size());
     }catch(const nlohmann::json::parse_error& error){
         std::cout << "Failed to parse request: " << error.what() << std::endl;
-        std::cout << "length: " << _body.size() << std::endl;
-        std::cout << "str: " << _body << std::endl;
+        std::cout << "length: " << body.size() << std::endl;
+        std::cout << "str: " << body.view() << std::endl;
     }
-    cbtl::packets::type type = static_cast<cbtl::packets::type>(_head.type);
-    // std::cout << "<< " << std::endl << req_json.dump(4) << std::endl;
-
-    std::clock_t start = std::clock();
-    if(type == cbtl::packets::type::request){
-        cbtl::packets::request req = req_json;
-        handle_request(req);
-    }else if(type == cbtl::packets::type::response && _challenge_data.challenged){
-        cbtl::packets::actions action = static_cast<cbtl::packets::actions>(req_json["action"]["type"].get<std::uint32_t>());
-        if(action == cbtl::packets::actions::identify){
-            using response_type = cbtl::packets::response<cbtl::packets::action_data<cbtl::packets::actions::identify>>;
-            response_type response = req_json;
-            cbtl::packets::result result = stage2(response);
-
-            std::clock_t end = std::clock();
-            long double duration = 1000.0 * (end - start) / CLOCKS_PER_SEC;
-            std::cout << std::format("Identified 1 record in {}ms", duration) << std::endl;
-        }else if(action == cbtl::packets::actions::fetch){
-            using response_type = cbtl::packets::response<cbtl::packets::action_data<cbtl::packets::actions::fetch>>;
-            response_type response = req_json;
-            cbtl::packets::result result = stage2(response);
-
-            std::clock_t end = std::clock();
-            long double duration = 1000.0 * (end - start) / CLOCKS_PER_SEC;
-            std::cout << std::format("Fetched {} records in {}ms", result.aux["cases"].size(), duration) << std::endl;
-        }else if(action == cbtl::packets::actions::insert){
-            using response_type = cbtl::packets::response<cbtl::packets::action_data<cbtl::packets::actions::insert>>;
-            response_type response = req_json;
-            cbtl::packets::result result = stage2(response);
-
-            std::clock_t end = std::clock();
-            long double duration = 1000.0 * (end - start) / CLOCKS_PER_SEC;
-            std::cout << std::format("Inserted {} records in {}ms", response.action().count(), duration) << std::endl;
-        }else if(action == cbtl::packets::actions::remove){
-            using response_type = cbtl::packets::response<cbtl::packets::action_data<cbtl::packets::actions::remove>>;
-            response_type response = req_json;
-            cbtl::packets::result result = stage2(response);
-        }
+    cbtl::buffer_pool::release(std::move(body));
+    co_return f;
+}
+
+void cbtl::session::close(){
+    boost::system::error_code ec;
+    _deadline.cancel(ec);
+    _socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+    _socket.close(ec);
+}
+
+cbtl::packets::result cbtl::session::respond(const nlohmann::json& req_json, challenge_data& challenge){
+    // wall clock, std::clock() would add up the cpu time of all server threads
+    auto start = std::chrono::steady_clock::now();
+    cbtl::packets::actions action = static_cast<cbtl::packets::actions>(req_json["action"]["type"].get<std::uint32_t>());
+    if(action == cbtl::packets::actions::identify){
+        using response_type = cbtl::packets::response<cbtl::packets::action_data<cbtl::packets::actions::identify>>;
+        response_type response = req_json;
+        cbtl::packets::result result = stage2(response, challenge);
+
+        std::chrono::duration<long double, std::milli> duration = std::chrono::steady_clock::now() - start;
+        std::cout << std::format("Identified 1 record in {}ms", duration.count()) << std::endl;
+        return result;
+    }else if(action == cbtl::packets::actions::fetch){
+        using response_type = cbtl::packets::response<cbtl::packets::action_data<cbtl::packets::actions::fetch>>;
+        response_type response = req_json;
+        cbtl::packets::result result = stage2(response, challenge);
+
+        std::chrono::duration<long double, std::milli> duration = std::chrono::steady_clock::now() - start;
+        std::cout << std::format("Fetched {} records in {}ms", result.aux["cases"].size(), duration.count()) << std::endl;
+        return result;
+    }else if(action == cbtl::packets::actions::insert){
+        using response_type = cbtl::packets::response<cbtl::packets::action_data<cbtl::packets::actions::insert>>;
+        response_type response = req_json;
+        cbtl::packets::result result = stage2(response, challenge);
+
+        std::chrono::duration<long double, std::milli> duration = std::chrono::steady_clock::now() - start;
+        std::cout << std::format("Inserted {} records in {}ms", response.action().count(), duration.count()) << std::endl;
+        return result;
+    }else if(action == cbtl::packets::actions::remove){
+        using response_type = cbtl::packets::response<cbtl::packets::action_data<cbtl::packets::actions::remove>>;
+        response_type response = req_json;
+        return stage2(response, challenge);
+    }else if(action == cbtl::packets::actions::batch){
+        using response_type = cbtl::packets::response<cbtl::packets::action_data<cbtl::packets::actions::batch>>;
+        response_type response = req_json;
+        cbtl::packets::result result = stage2(response, challenge);
+
+        std::chrono::duration<long double, std::milli> duration = std::chrono::steady_clock::now() - start;
+        std::cout << std::format("Processed a batch of {} actions in {}ms", response.action().count(), duration.count()) << std::endl;
+        return result;
+    }
+    return cbtl::packets::result::failure(400, "unknown action");
+}
+
+std::optional<cbtl::packets::result> cbtl::session::redeem(const cbtl::packets::resumption& resumption, challenge_data& challenge){
+    if(_config.ticket_lifetime == 0){
+        return cbtl::packets::result::failure(400, "resumption disabled");
+    }
+    cbtl::ticket ticket;
+    try{
+        ticket = cbtl::ticket::open(resumption.ticket, _ticket_key);
+    }catch(const std::exception& ex){
+        return cbtl::packets::result::failure(401, ex.what());
+    }
+    if(resumption.proof != cbtl::packets::resumption::prove(resumption.ticket, ticket.lambda)){
+        return cbtl::packets::result::failure(401, "ticket not held by its owner");
     }
-    do_read();
+    // a replayed ticket points to a tip that has already been extended, answer() rejects it
+    challenge = challenge_data{ticket.last, ticket.y, ticket.token, ticket.forward, ticket.lambda, ticket.shared, true, boost::posix_time::microsec_clock::local_time()};
+    return std::nullopt;
 }
-void cbtl::session::write_handler(){
 
+void cbtl::session::issue(cbtl::packets::result& result, const challenge_data& challenge){
+    if(result.error != 0 || !challenge.resume || _config.ticket_lifetime == 0){
+        return;
+    }
+    auto G = _master.pub().G();
+    CryptoPP::AutoSeededRandomPool rng;
+    cbtl::ticket ticket;
+    ticket.last    = challenge.last;
+    ticket.y       = challenge.y;
+    ticket.token   = challenge.token;
+    ticket.forward = challenge.forward;
+    ticket.lambda  = G.random(rng, true);
+    ticket.shared  = challenge.shared;
+    ticket.expiry  = std::chrono::duration_cast<std::chrono::seconds>(cbtl::ticket::clock_type::now().time_since_epoch()).count() + _config.ticket_lifetime;
+    result.aux["ticket"] = {
+        {"sealed", ticket.seal(_ticket_key)},
+        {"random", cbtl::utils::hex::encode(G.Gp().Multiply(ticket.lambda, ticket.shared), CryptoPP::Integer::UNSIGNED)}
+    };
 }
 
-void cbtl::session::handle_request(const cbtl::packets::request& req){
+void cbtl::session::send(cbtl::packets::basic_envelop&& envelop){
+    bool idle = _outbound.empty();
+    _outbound.push_back(std::move(envelop));
+    if(idle){
+        pointer self = shared_from_this();
+        boost::asio::co_spawn(_socket.get_executor(), [self]{ return self->flush(); }, boost::asio::detached);
+    }
+}
+
+boost::asio::awaitable<void> cbtl::session::flush(){
+    // header and body are gathered straight from the queued envelop, elements of a deque stay put while others are pushed or popped
+    try{
+        while(!_outbound.empty()){
+            co_await boost::asio::async_write(_socket, _outbound.front().buffers(), boost::asio::use_awaitable);
+            _outbound.pop_front();
+        }
+    }catch(const boost::system::system_error& error){
+        std::cout << "write: " << error.what() << std::endl;
+        _outbound.clear();
+    }
+}
+
+std::optional<cbtl::session::pending_challenge> cbtl::session::handle_request(const cbtl::packets::request& req, const cbtl::blocks::access& access){
     auto G = _master.pub().G();
-    // fetch req.last
-    cbtl::storage db;
-    cbtl::blocks::access access = db.fetch(req.last);
     // verify
     cbtl::keys::identity::public_key pub(req.y, _master.pub());
     bool verified = access.active().verify(req.token, pub, _master.pri());
@@ -137,49 +285,63 @@ void cbtl::session::handle_request(const cbtl::packets::request& req){
         // construct challenge
         CryptoPP::AutoSeededRandomPool rng;
         CryptoPP::Integer rho = G.random(rng, true), lambda = G.random(rng, true);
-        auto cipher = G.Gp().Multiply(lambda, G.Gp().Exponentiate(pub.y(), _master.pri().x()));
-        cbtl::packets::challenge challenge = access.active().challenge(rng, _master.pub().G(), req.token, rho, cipher);
-        _challenge_data.token      = req.token;
-        _challenge_data.y          = req.y;
-        _challenge_data.last       = access.address().id();
-        _challenge_data.challenged = true;
-        _challenge_data.forward    = access.active().forward();
-        _challenge_data.lambda     = lambda;
-        _challenge_data.requested  = boost::posix_time::microsec_clock::local_time();
-        // send challenge
-        cbtl::packets::envelop<cbtl::packets::challenge> envelop(cbtl::packets::type::challenge, challenge);
-        envelop.write(_socket);
-
-        nlohmann::json challenge_json = challenge;
+        auto shared = G.Gp().Exponentiate(pub.y(), _master.pri().x());
+        auto cipher = G.Gp().Multiply(lambda, shared);
+        pending_challenge pending;
+        pending.challenge = access.active().challenge(rng, _master.pub().G(), req.token, rho, cipher);
+        pending.data.token      = req.token;
+        pending.data.y          = req.y;
+        pending.data.last       = access.address().id();
+        pending.data.forward    = access.active().forward();
+        pending.data.lambda     = lambda;
+        pending.data.shared     = shared;
+        pending.data.resume     = req.resume;
+        pending.data.requested  = boost::posix_time::microsec_clock::local_time();
+
+        // nlohmann::json challenge_json = pending.challenge;
         // std::cout << ">> " << std::endl << challenge_json.dump(4) << std::endl;
+        return pending;
     }else{
         std::cout << "failed to verify" << std::endl;
+        return std::nullopt;
     }
 }
 
-CryptoPP::Integer cbtl::session::verify(const cbtl::packets::basic_response& response){
-    auto Gp = _master.pub().G().Gp(), Gp1 = _master.pub().G().Gp1();
-
+CryptoPP::Integer cbtl::session::verify(const cbtl::packets::basic_response& response, const challenge_data& challenge){
     // std::cout << "Verification Successful" << std::endl;
-    CryptoPP::Integer active_next = Gp.Multiply(_challenge_data.last, cbtl::utils::sha512::digest(_challenge_data.token, CryptoPP::Integer::UNSIGNED));
-    if(_db.exists(cbtl::utils::hex::encode(active_next, CryptoPP::Integer::UNSIGNED), true)){
-        std::cout << "Next active address already exists" << std::endl;
-        return 0;
-    }
-
-    return cbtl::keys::access_key::reconstruct(response.access(), _challenge_data.lambda, _master.pri());
+    return cbtl::keys::access_key::reconstruct(response.access(), challenge.lambda, _master.pri());
 }
 
-cbtl::blocks::access cbtl::session::make(const cbtl::keys::identity::public_key& passive_pub, const CryptoPP::Integer& gaccess, const nlohmann::json& contents){
-    cbtl::blocks::access last_passive = cbtl::blocks::last::passive(_db, passive_pub, gaccess, _master.pri());
+cbtl::blocks::access cbtl::session::make(const cbtl::keys::identity::public_key& passive_pub, const CryptoPP::Integer& gaccess, const nlohmann::json& contents, const challenge_data& challenge, CryptoPP::Integer& next){
+    // the walk resumes from the last tip this server has seen instead of the genesis block
+    std::string tip = cbtl::tip_cache::key(passive_pub.y(), gaccess);
+    std::optional<cbtl::blocks::access> known = _tips.get(tip);
+    cbtl::blocks::access last_passive = known ? cbtl::blocks::last::passive(_db, passive_pub, *known, gaccess, _master.pri())
+                                              : cbtl::blocks::last::passive(_db, passive_pub, gaccess, _master.pri());
+    _tips.advance(tip, last_passive);
     // std::cout << "last_pasive: " << last_passive.address().id() << std::endl;
-    cbtl::keys::identity::public_key pub(_challenge_data.y, _master.pub());
-    cbtl::blocks::params params( cbtl::blocks::params::active(_challenge_data.last, pub, _challenge_data.forward), last_passive, passive_pub, _master.pri(), gaccess, _challenge_data.requested);
+    cbtl::keys::identity::public_key pub(challenge.y, _master.pub());
+    cbtl::blocks::params params( cbtl::blocks::params::active(challenge.last, pub, challenge.forward), last_passive, passive_pub, _master.pri(), gaccess, challenge.requested);
     CryptoPP::AutoSeededRandomPool rng;
-    return cbtl::blocks::access::construct(rng, params, _master.pri(), _challenge_data.token, gaccess, last_passive.passive().forward(), _view, contents.dump(4));
+    return cbtl::blocks::access::construct(rng, params, _master.pri(), challenge.token, gaccess, last_passive.passive().forward(), _view, contents.dump(), next);
+}
+
+bool cbtl::session::append(const cbtl::blocks::access& block, const CryptoPP::Integer& next, challenge_data& challenge, const std::string& tip){
+    // add() refuses to overwrite an existing block or address, so two sessions racing to extend the same chain cannot both succeed
+    // the block is written together with the blocks of the other sessions, the compute thread waits for its batch
+    if(!_writes.add(block)){
+        return false;
+    }
+    // the block is also the new tip of the passive chain
+    _tips.advance(tip, block);
+    // the block is the new tip of the active chain, the next action of a batch extends it
+    challenge.last    = block.address().id();
+    challenge.forward = block.active().forward();
+    challenge.token   = next;
+    return true;
 }
 
-cbtl::packets::result cbtl::session::process(const cbtl::packets::action_data<cbtl::packets::actions::identify>& action, const CryptoPP::Integer& gaccess){
+cbtl::packets::result cbtl::session::process(const cbtl::packets::action_data<cbtl::packets::actions::identify>& action, const CryptoPP::Integer& gaccess, challenge_data& challenge){
     std::string anchor = action.anchor();
     pqxx::connection conn{"postgresql://cbtl_user@localhost/cbtl"};
     pqxx::work transaction{conn};
@@ -207,26 +369,25 @@ cbtl::packets::result cbtl::session::process(const cbtl::packets::action_data<cb
 
     cbtl::keys::identity::public_key passive_pub(y, _master.pub().G());
     nlohmann::json contents = {
-        {"active",  cbtl::utils::hex::encode(_challenge_data.y, CryptoPP::Integer::UNSIGNED)},
+        {"active",  cbtl::utils::hex::encode(challenge.y, CryptoPP::Integer::UNSIGNED)},
         {"passive", cbtl::utils::hex::encode(y, CryptoPP::Integer::UNSIGNED)},
         {"anchors", {
             anchor
         }}
     };
-    cbtl::blocks::access block = make(passive_pub, gaccess, contents);
-    if(_db.exists(block.address().hash())){
+    CryptoPP::Integer next;
+    cbtl::blocks::access block = make(passive_pub, gaccess, contents, challenge, next);
+    if(!append(block, next, challenge, cbtl::tip_cache::key(passive_pub.y(), gaccess))){
         return cbtl::packets::result::failure(403, "block already exists");
-    }else{
-        _db.add(block);
     }
 
-    return cbtl::packets::result::success(_challenge_data.y, y, block.address().hash(), {
+    return cbtl::packets::result::success(challenge.y, y, block.address().hash(), {
         {"anchor",  anchor}
     });
 
 }
 
-cbtl::packets::result cbtl::session::process(const cbtl::packets::action_data<cbtl::packets::actions::insert>& action, const CryptoPP::Integer& gaccess){
+cbtl::packets::result cbtl::session::process(const cbtl::packets::action_data<cbtl::packets::actions::insert>& action, const CryptoPP::Integer& gaccess, challenge_data& challenge){
     pqxx::connection conn{"postgresql://cbtl_user@localhost/cbtl"};
     pqxx::work transaction{conn};
 
@@ -273,25 +434,24 @@ cbtl::packets::result cbtl::session::process(const cbtl::packets::action_data<cb
     transaction.commit();
 
     nlohmann::json contents = {
-        {"active",  cbtl::utils::hex::encode(_challenge_data.y, CryptoPP::Integer::UNSIGNED)},
+        {"active",  cbtl::utils::hex::encode(challenge.y, CryptoPP::Integer::UNSIGNED)},
         {"passive", cbtl::utils::hex::encode(action.y(), CryptoPP::Integer::UNSIGNED)},
         {"anchors", anchors}
     };
 
     cbtl::keys::identity::public_key passive_pub(action.y(), _master.pub().G());
-    cbtl::blocks::access block = make(passive_pub, gaccess, contents);
-    if(_db.exists(block.address().hash())){
+    CryptoPP::Integer next;
+    cbtl::blocks::access block = make(passive_pub, gaccess, contents, challenge, next);
+    if(!append(block, next, challenge, cbtl::tip_cache::key(passive_pub.y(), gaccess))){
         return cbtl::packets::result::failure(403, "block already exists");
-    }else{
-        _db.add(block);
     }
 
-    return cbtl::packets::result::success(_challenge_data.y, action.y(), block.address().hash(), {
+    return cbtl::packets::result::success(challenge.y, action.y(), block.address().hash(), {
         {"last",  last}
     });
 }
 
-cbtl::packets::result cbtl::session::process(const cbtl::packets::action_data<cbtl::packets::actions::fetch>& action, const CryptoPP::Integer& gaccess){
+cbtl::packets::result cbtl::session::process(const cbtl::packets::action_data<cbtl::packets::actions::fetch>& action, const CryptoPP::Integer& gaccess, challenge_data& challenge){
     pqxx::connection conn{"postgresql://cbtl_user@localhost/cbtl"};
     pqxx::work transaction{conn};
 
@@ -327,25 +487,64 @@ cbtl::packets::result cbtl::session::process(const cbtl::packets::action_data<cb
     transaction.commit();
 
     nlohmann::json contents = {
-        {"active",  cbtl::utils::hex::encode(_challenge_data.y, CryptoPP::Integer::UNSIGNED)},
+        {"active",  cbtl::utils::hex::encode(challenge.y, CryptoPP::Integer::UNSIGNED)},
         {"passive", cbtl::utils::hex::encode(action.y(), CryptoPP::Integer::UNSIGNED)}
     };
 
     cbtl::keys::identity::public_key passive_pub(action.y(), _master.pub().G());
-    cbtl::blocks::access block = make(passive_pub, gaccess, contents);
-    if(_db.exists(block.address().hash())){
+    CryptoPP::Integer next;
+    cbtl::blocks::access block = make(passive_pub, gaccess, contents, challenge, next);
+    if(!append(block, next, challenge, cbtl::tip_cache::key(passive_pub.y(), gaccess))){
         return cbtl::packets::result::failure(403, "block already exists");
-    }else{
-        _db.add(block);
     }
 
-    return cbtl::packets::result::success(_challenge_data.y, action.y(), block.address().hash(), {
+    return cbtl::packets::result::success(challenge.y, action.y(), block.address().hash(), {
         {"cases", cases},
         {"last",  last}
     });
 }
 
-cbtl::packets::result cbtl::session::process(const cbtl::packets::action_data<cbtl::packets::actions::remove>& action, const CryptoPP::Integer& gaccess){
+cbtl::packets::result cbtl::session::process(const cbtl::packets::action_data<cbtl::packets::actions::batch>& action, const CryptoPP::Integer& gaccess, challenge_data& challenge){
+    // the challenge has been verified once for the whole batch, each action extends the active chain from the tip left by the previous one
+    // results holds one entry per action in order, applied counts the actions whose blocks were written
+    nlohmann::json results = nlohmann::json::array();
+    std::string block;
+    std::size_t applied = 0;
+    bool failed = false;
+    for(auto i = action.begin(); i != action.end(); ++i){
+        if(failed){
+            // the remaining actions are not applied, the client may retry them with a fresh challenge
+            results.push_back(cbtl::packets::result::failure(409, "not applied, an earlier action of the batch failed"));
+            continue;
+        }
+        cbtl::packets::result result = std::visit([&](const auto& a){ return process(a, gaccess, challenge); }, *i);
+        results.push_back(result);
+        if(result.error != 0){
+            failed = true;
+            continue;
+        }
+        block = result.block;
+        ++applied;
+    }
+    if(results.empty()){
+        return cbtl::packets::result::failure(400, "empty batch");
+    }
+    if(applied == 0){
+        cbtl::packets::result result = cbtl::packets::result::failure(results.front()["error"].get<std::uint32_t>(), results.front()["reason"].get<std::string>());
+        result.aux = {
+            {"results", results},
+            {"applied", applied}
+        };
+        return result;
+    }
+    // a partly applied batch succeeds with the tip of the last applied action, results tells which ones failed
+    return cbtl::packets::result::success(challenge.y, 0, block, {
+        {"results", results},
+        {"applied", applied}
+    });
+}
+
+cbtl::packets::result cbtl::session::process(const cbtl::packets::action_data<cbtl::packets::actions::remove>& action, const CryptoPP::Integer& gaccess, challenge_data& challenge){
     return cbtl::packets::result::failure(500, "Not Implemented");
 }
 
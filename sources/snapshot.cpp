@@ -0,0 +1,148 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "cbtl/snapshot.h"
+#include "cbtl/blocks/access.h"
+#include "cbtl/blocks/codec.h"
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cryptopp/crc.h>
+
+namespace{
+    constexpr char        magic[8]    = {'C', 'B', 'T', 'L', 'S', 'N', 'A', 'P'};
+    constexpr std::size_t header_size = sizeof(magic) + 4 + 8;
+    constexpr std::size_t record_size = 4 + 4;   ///< length and checksum before every block
+
+    std::uint32_t checksum(std::string_view data){
+        CryptoPP::byte digest[CryptoPP::CRC32::DIGESTSIZE];
+        CryptoPP::CRC32().CalculateDigest(digest, reinterpret_cast<const CryptoPP::byte*>(data.data()), data.size());
+        return std::uint32_t(digest[0]) | (std::uint32_t(digest[1]) << 8) | (std::uint32_t(digest[2]) << 16) | (std::uint32_t(digest[3]) << 24);
+    }
+
+    template <typename T>
+    void put(std::ostream& out, T value){
+        char bytes[sizeof(T)];
+        for(std::size_t i = 0; i < sizeof(T); ++i){
+            bytes[i] = static_cast<char>((static_cast<std::uint64_t>(value) >> (8 * (sizeof(T) - 1 - i))) & 0xFF);
+        }
+        out.write(bytes, sizeof(T));
+    }
+
+    template <typename T>
+    T get(const char* data){
+        std::uint64_t value = 0;
+        for(std::size_t i = 0; i < sizeof(T); ++i){
+            value = (value << 8) | static_cast<std::uint8_t>(data[i]);
+        }
+        return static_cast<T>(value);
+    }
+}
+
+cbtl::snapshot::writer::writer(const std::string& path): _out(path, std::ios::binary | std::ios::trunc), _path(path), _count(0) {
+    if(!_out){
+        throw std::runtime_error("snapshot: cannot create " + path);
+    }
+    _out.write(magic, sizeof(magic));
+    put<std::uint32_t>(_out, version);
+    put<std::uint64_t>(_out, 0);
+}
+
+cbtl::snapshot::writer::~writer(){
+    // a writer left without close() (e.g. unwound by an exception) did not see every block, its file is not sealed but removed
+    if(_out.is_open()){
+        _out.close();
+        std::remove(_path.c_str());
+    }
+}
+
+void cbtl::snapshot::writer::write(const cbtl::blocks::access& block){
+    std::string data = cbtl::blocks::codec::serialize(block);
+    put<std::uint32_t>(_out, data.size());
+    put<std::uint32_t>(_out, checksum(data));
+    _out.write(data.data(), data.size());
+    if(!_out){
+        throw std::runtime_error("snapshot: failed to write " + _path);
+    }
+    ++_count;
+}
+
+void cbtl::snapshot::writer::close(){
+    // the count is only known at the end, it is written once every block is
+    _out.seekp(sizeof(magic) + 4);
+    put<std::uint64_t>(_out, _count);
+    _out.close();
+    if(!_out){
+        throw std::runtime_error("snapshot: failed to write " + _path);
+    }
+}
+
+cbtl::snapshot::reader::reader(const std::string& path): _data(0x0), _size(0), _count(0) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0){
+        throw std::runtime_error("snapshot: cannot open " + path);
+    }
+    struct stat st;
+    if(::fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < header_size){
+        ::close(fd);
+        throw std::runtime_error("snapshot: " + path + " is not a snapshot");
+    }
+    _size = st.st_size;
+    void* data = ::mmap(0x0, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(data == MAP_FAILED){
+        throw std::runtime_error("snapshot: cannot map " + path);
+    }
+    _data = static_cast<const char*>(data);
+    // the records are read front to back
+    ::madvise(data, _size, MADV_SEQUENTIAL);
+    if(std::memcmp(_data, magic, sizeof(magic)) != 0 || get<std::uint32_t>(_data + sizeof(magic)) != version){
+        ::munmap(data, _size);
+        throw std::runtime_error("snapshot: " + path + " is not a snapshot of version " + std::to_string(version));
+    }
+    _count = get<std::uint64_t>(_data + sizeof(magic) + 4);
+    // every record takes at least its length and checksum, a larger count is corrupt and must not size an allocation
+    if(_count > (_size - header_size) / record_size){
+        ::munmap(data, _size);
+        throw std::runtime_error("snapshot: " + path + " claims " + std::to_string(_count) + " records, more than its size allows");
+    }
+}
+
+cbtl::snapshot::reader::~reader(){
+    ::munmap(const_cast<char*>(_data), _size);
+}
+
+std::vector<cbtl::snapshot::reader::record> cbtl::snapshot::reader::records() const{
+    std::vector<record> records;
+    records.reserve(_count);
+    std::size_t offset = header_size;
+    for(std::uint64_t i = 0; i < _count; ++i){
+        if(_size - offset < record_size){
+            throw std::runtime_error("snapshot: truncated at record " + std::to_string(i));
+        }
+        std::uint32_t length = get<std::uint32_t>(_data + offset);
+        std::uint32_t crc    = get<std::uint32_t>(_data + offset + 4);
+        offset += record_size;
+        if(_size - offset < length){
+            throw std::runtime_error("snapshot: truncated at record " + std::to_string(i));
+        }
+        records.push_back(record{std::string_view(_data + offset, length), crc});
+        offset += length;
+    }
+    return records;
+}
+
+bool cbtl::snapshot::reader::record::valid() const{
+    return ::checksum(data) == checksum;
+}
+
+cbtl::blocks::access cbtl::snapshot::reader::record::block() const{
+    if(!valid()){
+        throw std::runtime_error("snapshot: checksum mismatch");
+    }
+    return cbtl::blocks::codec::deserialize(data);
+}
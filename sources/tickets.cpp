@@ -0,0 +1,91 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "cbtl/tickets.h"
+#include "cbtl/utils.h"
+#include <stdexcept>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include <cryptopp/aes.h>
+#include <cryptopp/gcm.h>
+#include <cryptopp/osrng.h>
+#include <cryptopp/filters.h>
+#include <cryptopp/base64.h>
+
+namespace{
+    constexpr std::size_t iv_size  = 12;
+    constexpr int         tag_size = 16;
+    const std::string     domain   = "cbtl-ticket";
+}
+
+cbtl::ticket::key_type cbtl::ticket::key(const cbtl::keys::identity::private_key& master){
+    std::vector<CryptoPP::byte> bytes(domain.cbegin(), domain.cend());
+    std::size_t offset = bytes.size();
+    bytes.resize(offset + master.x().MinEncodedSize(CryptoPP::Integer::UNSIGNED));
+    master.x().Encode(&bytes[offset], bytes.size() - offset, CryptoPP::Integer::UNSIGNED);
+    key_type key;
+    CryptoPP::SHA256 hash;
+    hash.CalculateDigest(key.data(), bytes.data(), bytes.size());
+    return key;
+}
+
+std::string cbtl::ticket::seal(const key_type& key) const{
+    nlohmann::json plain = {
+        {"last",    cbtl::utils::hex::encode(last,    CryptoPP::Integer::UNSIGNED)},
+        {"y",       cbtl::utils::hex::encode(y,       CryptoPP::Integer::UNSIGNED)},
+        {"token",   cbtl::utils::hex::encode(token,   CryptoPP::Integer::UNSIGNED)},
+        {"forward", cbtl::utils::hex::encode(forward, CryptoPP::Integer::UNSIGNED)},
+        {"lambda",  cbtl::utils::hex::encode(lambda,  CryptoPP::Integer::UNSIGNED)},
+        {"shared",  cbtl::utils::hex::encode(shared,  CryptoPP::Integer::UNSIGNED)},
+        {"expiry",  expiry}
+    };
+
+    // iv || ciphertext || tag
+    CryptoPP::AutoSeededRandomPool rng;
+    CryptoPP::byte iv[iv_size];
+    rng.GenerateBlock(iv, iv_size);
+    std::string sealed(reinterpret_cast<const char*>(iv), iv_size);
+
+    CryptoPP::GCM<CryptoPP::AES>::Encryption enc;
+    enc.SetKeyWithIV(key.data(), key.size(), iv, iv_size);
+    CryptoPP::StringSource(plain.dump(), true, new CryptoPP::AuthenticatedEncryptionFilter(enc, new CryptoPP::StringSink(sealed), false, tag_size));
+
+    std::string encoded;
+    CryptoPP::StringSource(sealed, true, new CryptoPP::Base64Encoder(new CryptoPP::StringSink(encoded), false));
+    return encoded;
+}
+
+cbtl::ticket cbtl::ticket::open(const std::string& sealed, const key_type& key){
+    std::string decoded;
+    CryptoPP::StringSource(sealed, true, new CryptoPP::Base64Decoder(new CryptoPP::StringSink(decoded)));
+    if(decoded.size() < iv_size + tag_size){
+        throw std::invalid_argument("malformed ticket");
+    }
+
+    std::string plain;
+    try{
+        CryptoPP::GCM<CryptoPP::AES>::Decryption dec;
+        dec.SetKeyWithIV(key.data(), key.size(), reinterpret_cast<const CryptoPP::byte*>(decoded.data()), iv_size);
+        CryptoPP::StringSource(decoded.substr(iv_size), true, new CryptoPP::AuthenticatedDecryptionFilter(dec, new CryptoPP::StringSink(plain), CryptoPP::AuthenticatedDecryptionFilter::DEFAULT_FLAGS, tag_size));
+    }catch(const CryptoPP::HashVerificationFilter::HashVerificationFailed&){
+        throw std::invalid_argument("ticket failed authentication");
+    }
+
+    nlohmann::json j = nlohmann::json::parse(plain);
+    ticket t;
+    t.last    = cbtl::utils::hex::decode(j["last"].get<std::string>(),    CryptoPP::Integer::UNSIGNED);
+    t.y       = cbtl::utils::hex::decode(j["y"].get<std::string>(),       CryptoPP::Integer::UNSIGNED);
+    t.token   = cbtl::utils::hex::decode(j["token"].get<std::string>(),   CryptoPP::Integer::UNSIGNED);
+    t.forward = cbtl::utils::hex::decode(j["forward"].get<std::string>(), CryptoPP::Integer::UNSIGNED);
+    t.lambda  = cbtl::utils::hex::decode(j["lambda"].get<std::string>(),  CryptoPP::Integer::UNSIGNED);
+    t.shared  = cbtl::utils::hex::decode(j["shared"].get<std::string>(),  CryptoPP::Integer::UNSIGNED);
+    t.expiry  = j["expiry"].get<std::int64_t>();
+    if(t.expired()){
+        throw std::invalid_argument("ticket has expired");
+    }
+    return t;
+}
+
+bool cbtl::ticket::expired() const{
+    return std::chrono::duration_cast<std::chrono::seconds>(clock_type::now().time_since_epoch()).count() > expiry;
+}
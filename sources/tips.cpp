@@ -0,0 +1,41 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "cbtl/tips.h"
+#include "cbtl/utils.h"
+
+std::string cbtl::tip_cache::key(const CryptoPP::Integer& y, const CryptoPP::Integer& gaccess){
+    return cbtl::utils::hex::encode(y, CryptoPP::Integer::UNSIGNED) + ":" + cbtl::utils::sha256::str(gaccess, CryptoPP::Integer::UNSIGNED);
+}
+
+std::optional<cbtl::blocks::access> cbtl::tip_cache::get(const std::string& key){
+    if(_capacity == 0){
+        return std::nullopt;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _index.find(key);
+    if(it == _index.end()){
+        return std::nullopt;
+    }
+    _order.splice(_order.begin(), _order, it->second);
+    return it->second->second;
+}
+
+void cbtl::tip_cache::advance(const std::string& key, const cbtl::blocks::access& block){
+    if(_capacity == 0){
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _index.find(key);
+    if(it != _index.end()){
+        it->second->second = block;
+        _order.splice(_order.begin(), _order, it->second);
+        return;
+    }
+    _order.emplace_front(key, block);
+    _index.emplace(key, _order.begin());
+    if(_order.size() > _capacity){
+        _index.erase(_order.back().first);
+        _order.pop_back();
+    }
+}
@@ -0,0 +1,53 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <nlohmann/json.hpp>
+#include "cbtl/config.h"
+#include "cbtl/compression.h"
+#include "cbtl/blocks/io.h"
+#include "cbtl/blocks/codec.h"
+#include "tests.h"
+
+namespace{
+    bool same(const cbtl::blocks::access& left, const cbtl::blocks::access& right){
+        return cbtl::blocks::codec::serialize(left) == cbtl::blocks::codec::serialize(right);
+    }
+
+    void round_trip(const cbtl::blocks::access& block, int level){
+        cbtl::config config;
+        config.compression = level;
+        cbtl::compressor compressor(config);
+
+        std::string binary = cbtl::blocks::codec::serialize(block, compressor);
+        CBTL_CHECK(cbtl::blocks::codec::binary(binary));
+        CBTL_CHECK(same(cbtl::blocks::codec::deserialize(binary, compressor), block));
+
+        // blocks stored as JSON before the binary encoding are read through the same path
+        std::string json = nlohmann::json(block).dump();
+        CBTL_CHECK(!cbtl::blocks::codec::binary(json));
+        CBTL_CHECK(!cbtl::compressor::compressed(json));
+        CBTL_CHECK(same(cbtl::blocks::codec::deserialize(json, compressor), block));
+        CBTL_CHECK(same(cbtl::blocks::codec::deserialize(json), block));
+    }
+}
+
+int main(){
+    cbtl::tests::genesis genesis;
+    cbtl::blocks::access block = genesis.next();
+
+    std::string encoded = cbtl::blocks::codec::serialize(block);
+    CBTL_CHECK(!cbtl::compressor::compressed(encoded));
+    CBTL_CHECK(same(cbtl::blocks::codec::deserialize(encoded), block));
+    CBTL_CHECK(cbtl::blocks::view(encoded).block().address().hash() == block.address().hash());
+
+    round_trip(block, 0);
+#if defined(CBTL_WITH_ZSTD)
+    round_trip(block, 3);
+#endif
+
+    // a JSON document whose fourth byte has the compressed flag bit set is not a compressed block
+    CBTL_CHECK(!cbtl::compressor::compressed("{\"ac\":1}"));
+    CBTL_CHECK(cbtl::tests::throws<std::invalid_argument>([&]{ cbtl::blocks::view(std::string_view("{\"ac\":1}")); }));
+
+    return cbtl::tests::result();
+}
@@ -0,0 +1,125 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <fstream>
+#include <filesystem>
+#include <nlohmann/json.hpp>
+#include "cbtl/config.h"
+#include "cbtl/storage.h"
+#include "cbtl/memory-storage.h"
+#include "cbtl/blocks/io.h"
+#include "cbtl/blocks/codec.h"
+#include "tests.h"
+
+namespace{
+    std::string address(const cbtl::blocks::access& block){
+        return cbtl::utils::hex::encode(block.address().active(), CryptoPP::Integer::UNSIGNED);
+    }
+
+    bool same(const cbtl::blocks::access& left, const cbtl::blocks::access& right){
+        return cbtl::blocks::codec::serialize(left) == cbtl::blocks::codec::serialize(right);
+    }
+
+    /**
+     * @brief add, fetch, resolve and scan through the engine at the compression level
+     */
+    void round_trip(cbtl::tests::genesis& genesis, int level){
+        cbtl::config config;
+        config.path = "";
+        config.compression = level;
+        cbtl::engines::memory engine(config);
+
+        cbtl::blocks::access block = genesis.next();
+        std::string block_id = block.address().hash();
+        CBTL_CHECK(engine.add(block));
+        CBTL_CHECK(!engine.add(block));
+        CBTL_CHECK(engine.exists(block_id));
+        CBTL_CHECK(engine.exists(address(block), true));
+        CBTL_CHECK(engine.id(address(block)) == block_id);
+        CBTL_CHECK(same(engine.fetch(block_id), block));
+        std::optional<cbtl::blocks::access> resolved = engine.resolve(address(block));
+        CBTL_CHECK(resolved && same(*resolved, block));
+        CBTL_CHECK(!engine.resolve("00"));
+        CBTL_CHECK(cbtl::tests::throws<std::out_of_range>([&]{ engine.fetch("00"); }));
+
+        std::vector<bool> written = engine.add_batch({genesis.next(), block, genesis.next()});
+        CBTL_CHECK(written.size() == 3 && written[0] && !written[1] && written[2]);
+        std::size_t scanned = 0;
+        engine.scan_blocks([&scanned](const cbtl::blocks::access&){ ++scanned; });
+        CBTL_CHECK(scanned == 3);
+    }
+
+    /**
+     * @brief a ledger file holding one JSON and one binary block (compressed if level > 0) is read back by an engine at another level
+     */
+    void mixed(cbtl::tests::genesis& genesis, int level){
+        std::filesystem::path dir = std::filesystem::temp_directory_path() / "cbtl-test-memory";
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir);
+
+        cbtl::blocks::access json_block = genesis.next(), binary_block = genesis.next();
+        {
+            cbtl::config config;
+            config.path = dir.string();
+            config.compression = level;
+            cbtl::compressor compressor(config);
+            std::string values[] = {nlohmann::json(json_block).dump(), cbtl::blocks::codec::serialize(binary_block, compressor)};
+            std::ofstream out(dir / "memory.ledger", std::ios::binary | std::ios::trunc);
+            for(const std::string& value: values){
+                std::uint32_t size = value.size();
+                std::uint8_t size_bytes[4] = {std::uint8_t(size >> 24), std::uint8_t(size >> 16), std::uint8_t(size >> 8), std::uint8_t(size)};
+                out.write(reinterpret_cast<const char*>(size_bytes), sizeof(size_bytes));
+                out.write(value.data(), value.size());
+            }
+        }
+        for(int reader: {0, level}){
+            cbtl::config config;
+            config.path = dir.string();
+            config.compression = reader;
+            cbtl::engines::memory engine(config);
+            CBTL_CHECK(same(engine.fetch(json_block.address().hash()), json_block));
+            CBTL_CHECK(same(engine.fetch(binary_block.address().hash()), binary_block));
+        }
+        std::filesystem::remove_all(dir);
+    }
+
+    /**
+     * @brief the cache and the address filter in front of the engine
+     */
+    void wrappers(cbtl::tests::genesis& genesis){
+        cbtl::config config;
+        config.path = "";
+        config.cache_blocks = 2;
+        cbtl::storage<cbtl::engines::memory> db(config);
+
+        cbtl::blocks::access first = genesis.next();
+        CBTL_CHECK(db.add(first));
+        CBTL_CHECK(same(db.fetch(first.address().hash()), first));
+        CBTL_CHECK(same(db.fetch(first.address().hash()), first));
+
+        db.track(1024);
+        CBTL_CHECK(db.index_filter()->count() >= 1);
+        CBTL_CHECK(db.exists(address(first), true));
+        CBTL_CHECK(!db.exists("00", true));
+        // blocks written through the storage after track() are added to the filter
+        cbtl::blocks::access second = genesis.next();
+        CBTL_CHECK(db.add(second));
+        CBTL_CHECK(db.exists(address(second), true));
+        std::optional<cbtl::blocks::access> resolved = db.resolve(address(second));
+        CBTL_CHECK(resolved && same(*resolved, second));
+    }
+}
+
+int main(){
+    cbtl::tests::genesis genesis;
+
+    round_trip(genesis, 0);
+    mixed(genesis, 0);
+#if defined(CBTL_WITH_ZSTD)
+    round_trip(genesis, 3);
+    mixed(genesis, 3);
+#endif
+    wrappers(genesis);
+
+    return cbtl::tests::result();
+}
@@ -0,0 +1,53 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <string>
+#include <vector>
+#include "cbtl/redis-ring.h"
+#include "cbtl/redis-keys.h"
+#include "tests.h"
+
+int main(){
+    cbtl::redis_ring::endpoint e = cbtl::redis_ring::endpoint::parse("10.0.0.1:6380");
+    CBTL_CHECK(e.host == "10.0.0.1" && e.port == 6380);
+    CBTL_CHECK(cbtl::redis_ring::endpoint::parse("10.0.0.1").port == 6379);
+    CBTL_CHECK(cbtl::tests::throws<std::invalid_argument>([]{ cbtl::redis_ring::endpoint::parse("10.0.0.1:x"); }));
+    CBTL_CHECK(cbtl::tests::throws<std::invalid_argument>([]{ cbtl::redis_ring ring(std::vector<std::string>{}); }));
+
+    CBTL_CHECK(cbtl::redis_ring::route("id:ABCD") == "ABCD");
+    CBTL_CHECK(cbtl::redis_ring::route("addr:ABCD") == "ABCD");
+
+    cbtl::redis_ring three({"127.0.0.1:6379", "127.0.0.1:6380", "127.0.0.1:6381"});
+    cbtl::redis_ring four({"127.0.0.1:6379", "127.0.0.1:6380", "127.0.0.1:6381", "127.0.0.1:6382"});
+    const std::size_t keys = 30000;
+    std::vector<std::size_t> load(three.size(), 0);
+    std::size_t moved = 0;
+    for(std::size_t i = 0; i < keys; ++i){
+        std::string key = cbtl::redis_keys::raw(std::to_string(i * 7919 + 1));
+        std::size_t shard = three.locate(key);
+        CBTL_CHECK(shard == three.locate(key));
+        ++load[shard];
+        std::size_t after = four.locate(key);
+        if(four.at(after).str() != three.at(shard).str()){
+            // a key only ever moves to the new shard
+            CBTL_CHECK(after == 3);
+            ++moved;
+        }
+    }
+    for(std::size_t count: load){
+        CBTL_CHECK(count > keys / 3 / 2 && count < keys / 3 * 2);
+    }
+    CBTL_CHECK(moved > keys / 4 / 2 && moved < keys / 4 * 2);
+
+    // the keys are the raw bytes of the hex ids
+    cbtl::redis_keys full, compact(16);
+    CBTL_CHECK(full.block("0AFF") == std::string("id:\x0A\xFF", 5));
+    CBTL_CHECK(cbtl::redis_keys::hex(cbtl::redis_keys::raw("0aff")) == "0AFF");
+    CBTL_CHECK(cbtl::redis_keys::raw("AFF") == std::string("\x0A\xFF", 2));
+    CBTL_CHECK(full.address_of(full.address("0AFF")) == std::optional<std::string>("0AFF"));
+    CBTL_CHECK(compact.address("0AFF").size() == 5 + 16);
+    CBTL_CHECK(!compact.address_of(compact.address("0AFF")));
+    CBTL_CHECK(cbtl::tests::throws<std::invalid_argument>([]{ cbtl::redis_keys keys(4); }));
+
+    return cbtl::tests::result();
+}
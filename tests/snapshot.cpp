@@ -0,0 +1,57 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <vector>
+#include <fstream>
+#include <filesystem>
+#include "cbtl/snapshot.h"
+#include "cbtl/blocks/codec.h"
+#include "tests.h"
+
+int main(){
+    cbtl::tests::genesis genesis;
+    std::vector<cbtl::blocks::access> blocks = {genesis.next(), genesis.next(), genesis.next()};
+    std::string path = (std::filesystem::temp_directory_path() / "cbtl-test.snap").string();
+
+    {
+        cbtl::snapshot::writer writer(path);
+        for(const cbtl::blocks::access& block: blocks){
+            writer.write(block);
+        }
+        writer.close();
+        CBTL_CHECK(writer.count() == blocks.size());
+    }
+    {
+        cbtl::snapshot::reader reader(path);
+        CBTL_CHECK(reader.count() == blocks.size());
+        std::vector<cbtl::snapshot::reader::record> records = reader.records();
+        CBTL_CHECK(records.size() == blocks.size());
+        for(std::size_t i = 0; i < records.size() && i < blocks.size(); ++i){
+            CBTL_CHECK(records[i].valid());
+            CBTL_CHECK(cbtl::blocks::codec::serialize(records[i].block()) == cbtl::blocks::codec::serialize(blocks[i]));
+        }
+    }
+
+    // a truncated file is reported by records(), not read past its end
+    std::filesystem::resize_file(path, 8 + 4 + 8 + 3 * (4 + 4));
+    CBTL_CHECK(cbtl::tests::throws<std::runtime_error>([&]{ cbtl::snapshot::reader reader(path); reader.records(); }));
+
+    // a count larger than the file can hold is rejected before anything is allocated for it
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(8 + 4);
+        const char huge[8] = {'\x7F', '\xFF', '\xFF', '\xFF', '\xFF', '\xFF', '\xFF', '\xFF'};
+        file.write(huge, sizeof(huge));
+    }
+    CBTL_CHECK(cbtl::tests::throws<std::runtime_error>([&]{ cbtl::snapshot::reader reader(path); }));
+
+    // a writer destroyed without close() leaves no file behind
+    {
+        cbtl::snapshot::writer writer(path);
+        writer.write(blocks[0]);
+    }
+    CBTL_CHECK(!std::filesystem::exists(path));
+
+    std::filesystem::remove(path);
+    return cbtl::tests::result();
+}
@@ -0,0 +1,90 @@
+// SPDX-FileCopyrightText: 2023 Sunanda Bose <sunanda@simula.no>
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef cbtl_TESTS_H
+#define cbtl_TESTS_H
+
+#include <string>
+#include <iostream>
+#include <stdexcept>
+#include <functional>
+#include <cryptopp/osrng.h>
+#include "cbtl/keys.h"
+#include "cbtl/utils.h"
+#include "cbtl/blocks.h"
+#include "cbtl/math/group.h"
+
+/**
+ * @brief minimal check harness, a test executable returns cbtl::tests::result() so that ctest sees the failures
+ */
+#define CBTL_CHECK(expr) cbtl::tests::check((expr), #expr, __FILE__, __LINE__)
+
+namespace cbtl{
+namespace tests{
+
+inline std::size_t failures = 0;
+
+inline void check(bool ok, const char* expr, const char* file, int line){
+    if(!ok){
+        std::cerr << file << ":" << line << ": check failed: " << expr << std::endl;
+        ++failures;
+    }
+}
+
+/**
+ * @brief true if f throws ExceptionT
+ */
+template <typename ExceptionT>
+bool throws(const std::function<void ()>& f){
+    try{
+        f();
+    }catch(const ExceptionT&){
+        return true;
+    }catch(...){
+        return false;
+    }
+    return false;
+}
+
+inline int result(){
+    if(failures){
+        std::cerr << failures << " checks failed" << std::endl;
+    }
+    return failures ? 1 : 0;
+}
+
+/**
+ * @brief genesis blocks signed by one trusted server key, constructed the way cbtl-init does
+ */
+class genesis{
+    CryptoPP::AutoSeededRandomPool     _rng;
+    cbtl::keys::identity::pair         _master;
+    CryptoPP::Integer                  _h;
+  public:
+    explicit genesis(std::uint32_t key_size = 1024): _master(_rng, key_size) {
+        cbtl::math::group G = _master.pub();
+        auto g   = G.g();
+        auto Gp  = G.Gp();
+        auto Gp1 = G.Gp1();
+        CryptoPP::Integer h_inverse = 0;
+        while(h_inverse == 0 || Gp.Exponentiate(Gp.Exponentiate(g, h_inverse), _h) != g){
+            CryptoPP::Integer theta = _master.pub().random(_rng, false);
+            _h = cbtl::utils::sha512::digest(Gp.Exponentiate(g, theta), CryptoPP::Integer::UNSIGNED);
+            h_inverse = Gp1.MultiplicativeInverse(_h);
+        }
+    }
+    /**
+     * @brief a genesis block of a fresh identity
+     */
+    cbtl::blocks::access next(){
+        cbtl::keys::identity::pair key(_rng, _master.pri());
+        auto now = boost::posix_time::microsec_clock::local_time();
+        cbtl::blocks::params params = cbtl::blocks::params::genesis(_master.pri(), key.pub(), now);
+        return cbtl::blocks::access::genesis(_rng, params, _master.pri(), _h);
+    }
+};
+
+}
+}
+
+#endif // cbtl_TESTS_H